@@ -5,6 +5,31 @@
  * Fixed console flooding by removing repeated printf in draw_thick_line
  * Increased line thickness and changed color to red for visibility
  * Simplified draw_thick_line to test single-line rendering
+ * Right-click deletes the nearest point (tombstone deletion in the point table)
+ * Repeated point labels follow --duplicates=error|first|last (default: last wins)
+ * --dedup-lines drops repeated lines regardless of endpoint order
+ * --check validates a .vd file with file:line diagnostics and exits without SDL
+ * --stats prints bounds, counts, degree and label length statistics as JSON
+ * Parse diagnostics are collected (kind, line, byte offset) and capped instead of printed per record
+ * Drawing files may be gzip-compressed (.vd.gz); they are inflated on a separate thread while parsing
+ * --points=FILE.csv (label,x,y) and --edges=FILE.csv (label1,label2) import CSV into the same drawing
+ * --geojson=FILE.json imports point and polyline features with a streaming JSON scanner
+ * --svg=OUT.svg exports the drawing through a buffered writer, linking or embedding the base image
+ * --frames=OUT renders the drawing growing point by point as a Y4M or PPM stream, without a window
+ * point(x,y,label,time) takes an optional time; 't' toggles a time-range scrubber (',' '.' move, '-' '=' resize)
+ * point(x,y,label,key=value,...) attributes are stored per key as columns; --filter="score>0.8 && class==3", 'f' toggles
+ * 'h' (or --heatmap) shows point density as a blurred, color-mapped heatmap; '[' ']' change the blur
+ * 'p' cycles a point cloud mode that writes 1x1 or 2x2 pixels per point into a streaming texture
+ * 'l' replaces vector lines with a tone-mapped line density accumulated in per-thread bands
+ * Mouse wheel zooms, middle-drag or arrow keys pan, Home resets; a cached minimap ('m') shows and jumps the view
+ * 'v' splits the window into two panes with their own viewports over the same textures and drawing
+ * --compare=IMAGE keeps a second image resident; 'c' cycles swipe, flicker and difference views under the overlay
+ * '1'-'6' adjust brightness, contrast and gamma ('0' resets) via color modulation or a tiled lookup-table worker
+ * The HUD ('i') reads the RGB value under the cursor from the retained CPU copy of the image
+ * Channel histograms are computed in the background after the first frame and shown in the HUD; 'a' auto-contrasts
+ * Left-click places a point snapped to the strongest nearby edge (Alt places it as clicked), from per-tile Sobel maps
+ * --serve=SOCKET runs a render server on a UNIX socket with a worker pool that keeps fonts loaded and
+ *   shares memory-budgeted LRU caches of decoded images and parsed drawings, keyed by path and mtime
  */
 
 #define _CRT_SECURE_NO_WARNINGS
@@ -16,12 +41,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <zlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 // --- Struct Definitions ---
 typedef struct {
     int x;
     int y;
     char* label; // Mandatory label
+    double time; // Optional fourth point() field; NAN when absent
 } Point;
 
 typedef struct {
@@ -32,17 +67,510 @@ typedef struct {
 typedef struct {
     char* label;
     Point point;
+    int index; // Slot of this point in the loaded points array
     bool used;
+    bool deleted; // Tombstone: slot stays "used" so probe chains past it still resolve
 } HashEntry;
 
 typedef struct {
     HashEntry* entries;
     int size;
+    int count;      // Live entries
+    int tombstones; // Deleted entries not yet reclaimed by compaction
 } HashTable;
 
+// Open-addressed set of packed (min,max) point index pairs, used to drop repeated edges
+typedef struct {
+    uint64_t* keys;
+    int size; // Power of two
+    int count;
+} LineSet;
+
+// Sequential reader over plain or gzip input. Gzip data is inflated on a separate thread
+// into a pair of chunk buffers, so decompression overlaps with parsing.
+typedef struct {
+    FILE* file;           // Plain input
+    gzFile gz;            // Compressed input
+    char* chunks[2];
+    int lengths[2];
+    bool filled[2];       // Chunk holds data the consumer has not released
+    bool stop;            // Consumer is closing; the inflate thread should exit
+    bool failed;          // Read or inflate error
+    bool finished;        // End of input reached
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* changed;
+    int current;          // Chunk the consumer is reading
+    bool holding;         // Consumer holds chunks[current]
+    char* data;           // Current chunk as seen by the consumer
+    int length;
+    int position;
+    int64_t chunk_offset; // Input offset of data[0]
+    char* line;           // Assembly buffer for lines spanning chunks
+} ChunkReader;
+
+typedef enum {
+    JSON_END,
+    JSON_ERROR,
+    JSON_BEGIN_OBJECT,
+    JSON_END_OBJECT,
+    JSON_BEGIN_ARRAY,
+    JSON_END_ARRAY,
+    JSON_COMMA,
+    JSON_COLON,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_LITERAL // true, false or null
+} JsonToken;
+
+// Pull tokenizer over a ChunkReader; never holds more than one token of text
+typedef struct {
+    ChunkReader* reader;
+    char* text;      // Last string token, truncated to MAX_RECORD_LENGTH
+    int text_length;
+    double number;   // Last number token
+    int line_number; // 1-based line of the next unread byte
+    int feature_count;
+} JsonScanner;
+
+// One GeoJSON feature (or bare geometry) being read; emitted when its object closes
+typedef struct {
+    char type[24];        // Geometry type, e.g. "LineString"
+    char* label;          // From properties.label, .name or .id
+    int label_priority;
+    double* coordinates;  // x,y pairs
+    int vertex_count;
+    int vertex_capacity;
+    int* part_ends;       // Vertex count at the end of each line/ring
+    int part_count;
+    int part_capacity;
+    int line_number;      // Where the feature starts
+    int64_t byte_offset;
+} GeoFeature;
+
+typedef enum {
+    DUPLICATE_ERROR,      // Report repeated labels as errors, keep the first point
+    DUPLICATE_FIRST_WINS, // Silently keep the first point
+    DUPLICATE_LAST_WINS   // Later definitions overwrite the earlier point
+} DuplicatePolicy;
+
+typedef enum {
+    DIAG_OPEN_FAILED,
+    DIAG_POINT_SYNTAX,
+    DIAG_POINT_BAD_X,
+    DIAG_POINT_BAD_Y,
+    DIAG_POINT_MISSING_LABEL,
+    DIAG_POINT_BAD_TIME,
+    DIAG_POINT_BAD_ATTRIBUTE,
+    DIAG_ATTRIBUTE_TYPE,
+    DIAG_DUPLICATE_LABEL,
+    DIAG_LINE_SYNTAX,
+    DIAG_LINE_MISSING_LABEL,
+    DIAG_UNDEFINED_POINT,
+    DIAG_RECORD_TOO_LONG,
+    DIAG_READ_FAILED,
+    DIAG_CSV_FIELD_COUNT,
+    DIAG_CSV_EMPTY_HEADER,
+    DIAG_JSON_SYNTAX,
+    DIAG_JSON_GEOMETRY,
+    DIAG_KIND_COUNT
+} DiagnosticKind;
+
+// Compact record of a parse problem; the message text comes from the kind
+typedef struct {
+    int16_t kind;
+    int16_t source;      // Index into Drawing.sources
+    int32_t line_number; // 1-based, 0 for the whole file
+    int64_t byte_offset; // Start of the offending line
+} Diagnostic;
+
+typedef struct {
+    int points;
+    int lines;
+    int duplicate_labels;
+    int duplicate_lines; // Removed by --dedup-lines
+    int errors;
+    int warnings;
+    Diagnostic* diagnostics; // The MAX_DIAGNOSTICS earliest by file and position, in that order once a file is loaded
+    int diagnostic_count;
+    bool diagnostics_heap;   // Full and kept as a max-heap on position, until sorted again
+} LoadStats;
+
+typedef struct {
+    DuplicatePolicy duplicate_policy;
+    bool dedup_lines;
+    bool verbose; // Echo every parsed record to stdout
+} LoadOptions;
+
+// A timed point in the drawing's time index
+typedef struct {
+    double time;
+    int point;
+} TimeEntry;
+
+// Per-point reasons a point is hidden; a point is drawn when no bit is set
+#define POINT_HIDDEN_BY_TIME 0x01
+#define POINT_HIDDEN_BY_FILTER 0x02
+
+typedef enum {
+    ATTRIBUTE_NUMBER,
+    ATTRIBUTE_STRING
+} AttributeType;
+
+// One key=value attribute stored as a column parallel to points. The type is fixed by the
+// first value; missing values are NAN (numbers) or -1 (strings).
+typedef struct {
+    char* key;
+    AttributeType type;
+    double* numbers;
+    int* codes;            // Index into values
+    HashTable* dictionary; // String value -> code
+    char** values;
+    int value_count;
+} AttributeColumn;
+
+// A parsed drawing: points in file order, lines between them, and the label index
+typedef struct {
+    Point* points;
+    int point_count;
+    int point_capacity;
+    Line* lines;
+    int line_count;
+    int line_capacity;
+    HashTable* point_table;
+    LoadStats stats;
+    char** sources; // Files the drawing was loaded from, referenced by diagnostics
+    int source_count;
+    Uint8* point_flags;     // POINT_HIDDEN_* bits, parallel to points
+    AttributeColumn* columns; // Each sized to point_capacity
+    int column_count;
+    TimeEntry* time_index;  // Timed points sorted by time, built on demand
+    int time_count;
+    bool time_index_valid;
+    unsigned int revision;  // Bumped whenever points, lines or their visibility change
+    LineSet seen_lines;     // Lines kept so far with --dedup-lines, across every loaded file
+} Drawing;
+
+// Point density overlay: a histogram at image resolution, optionally blurred, colored through a LUT
+typedef struct {
+    int width;
+    int height;
+    float sigma;            // Gaussian blur radius in pixels; 0 disables the blur
+    Uint32* counts;         // Merged histogram
+    float* density;
+    float* scratch;         // Blur intermediate
+    Uint32 lut[256];        // ARGB8888, entry 0 transparent
+    SDL_Texture* texture;   // Streaming
+    unsigned int revision;  // Drawing revision the texture shows
+    float built_sigma;
+    bool built;
+} Heatmap;
+
+typedef enum {
+    FILTER_COMPARE,
+    FILTER_AND,
+    FILTER_OR
+} FilterNodeKind;
+
+typedef enum {
+    FILTER_EQ,
+    FILTER_NE,
+    FILTER_LT,
+    FILTER_LE,
+    FILTER_GT,
+    FILTER_GE
+} FilterOp;
+
+// Compiled filter expression; comparisons reference attribute columns by index
+typedef struct FilterNode {
+    FilterNodeKind kind;
+    struct FilterNode* left;
+    struct FilterNode* right;
+    int column;
+    FilterOp op;
+    double number; // Operand for number columns
+    int code;      // Operand for string columns; -2 when the string never occurs
+} FilterNode;
+
+// The visible time range [start, start + width] and the time index entries it covers
+typedef struct {
+    bool enabled;
+    double start;
+    double width;
+    int first; // Visible entries are time_index[first, last)
+    int last;
+} TimeScrubber;
+
+#define DEGREE_HISTOGRAM_BUCKETS 32 // The last bucket counts every degree >= DEGREE_HISTOGRAM_BUCKETS - 1
+
+// Summary of a loaded drawing, computed by --stats
+typedef struct {
+    int min_x, min_y, max_x, max_y; // Bounding box, valid when the drawing has points
+    int min_degree, max_degree;
+    double mean_degree;
+    int degree_histogram[DEGREE_HISTOGRAM_BUCKETS];
+    int min_label_length, max_label_length;
+    double mean_label_length;
+} DrawingStats;
+
+typedef enum {
+    SVG_IMAGE_LINK,  // Reference the base image by path
+    SVG_IMAGE_EMBED, // Inline the image file as a base64 data URI
+    SVG_IMAGE_NONE
+} SvgImageMode;
+
+typedef enum {
+    FRAME_FORMAT_Y4M, // YUV 4:4:4 stream
+    FRAME_FORMAT_PPM  // Concatenated binary PPM images
+} FrameFormat;
+
+// Output buffered in large blocks; errors are sticky and reported on close
+typedef struct {
+    FILE* file;
+    char* buffer;
+    int length;
+    bool failed;
+} BufferedWriter;
+
+typedef struct {
+    const char* image_path;
+    const char* drawing_file_path;
+    const char* points_csv_path; // label,x,y rows
+    const char* edges_csv_path;  // label1,label2 rows
+    const char* geojson_path;    // Point/LineString features
+    LoadOptions load;
+    bool check; // Parse and validate the drawing only, without initializing SDL
+    bool heatmap; // Start the viewer in heatmap mode
+    bool stats; // Print drawing statistics as JSON, without initializing SDL
+    const char* svg_path; // Export the drawing as SVG instead of opening a window
+    SvgImageMode svg_image;
+    const char* filter; // Attribute filter expression, e.g. "score>0.8 && class==3"
+    const char* frames_path; // Render a frame sequence instead of opening a window
+    FrameFormat frame_format;
+    int frame_step; // Points added per frame; 0 picks about 100 frames
+    bool frame_order_by_time;
+    int frame_rate;
+    const char* compare_path; // Second image for before/after comparison in the viewer
+    const char* serve_path;   // Run the render server on this UNIX socket instead of opening a window
+    int server_workers;       // 0 uses one per CPU
+    int image_cache_mb;       // Render server memory budgets
+    int drawing_cache_mb;
+} Options;
+
+// Direct-to-pixel overlay for very large drawings: visible point coordinates are copied into
+// structure-of-arrays form and scattered straight into a streaming texture
+typedef struct {
+    int width;
+    int height;
+    int point_size;         // 1 or 2 pixels per side
+    Sint32* xs;
+    Sint32* ys;
+    int count;
+    int capacity;
+    SDL_Texture* texture;
+    unsigned int revision;  // Drawing revision the coordinates were copied at
+    int built_size;
+    bool built;
+} PointCloud;
+
+// Line density overlay: visible lines rasterized into per-pixel hit counts, then tone-mapped.
+// Each worker owns a horizontal band of counts, so accumulation needs no atomics.
+typedef struct {
+    int width;
+    int height;
+    Uint32* counts;
+    Sint32* endpoints;      // x1, y1, x2, y2 per visible line
+    int line_count;
+    int line_capacity;
+    Uint32 lut[256];        // ARGB8888, entry 0 transparent
+    SDL_Texture* texture;   // Streaming
+    unsigned int revision;
+    bool built;
+} LineDensity;
+
+// Maps image coordinates into a pane of the window: pane-local = (image - origin) * zoom
+typedef struct {
+    double x;      // Image coordinate at the pane's left edge
+    double y;      // Image coordinate at the pane's top edge
+    double zoom;   // Screen pixels per image pixel
+    SDL_Rect pane; // Window rectangle the view renders into
+} Viewport;
+
+// Overview pane: a small composite of the image and overlay, cached in a target texture
+typedef struct {
+    SDL_Rect pane;          // Size of the composite; placed in the top-right of each view
+    double scale;           // Minimap pixels per image pixel
+    SDL_Texture* texture;
+    unsigned int revision;  // Drawing revision the composite shows
+    bool built;
+} Minimap;
+
+typedef enum {
+    COMPARE_OFF,
+    COMPARE_SWIPE,      // Second image right of a draggable divider
+    COMPARE_FLICKER,    // Alternate between the images
+    COMPARE_DIFFERENCE, // Per-channel |a - b|
+    COMPARE_MODE_COUNT
+} CompareMode;
+
+// Before/after review: both images stay resident as textures, so every mode is a composite
+typedef struct {
+    SDL_Texture* texture;    // Second image, scaled to the first image's size
+    SDL_Surface* surface;    // The same in ARGB8888, the source for its adjusted copy
+    SDL_Texture* difference; // Computed once on the CPU when the images are loaded
+    CompareMode mode;
+    double swipe_x; // Divider position in image coordinates
+} Comparison;
+
+// Base image brightness/contrast/gamma. Pure gain up to 2x is drawn with texture color
+// modulation; anything else goes through a 256-entry lookup table
+typedef struct {
+    float gain;     // Brightness as a multiplier
+    float contrast; // Slope around mid-grey
+    float gamma;
+} ImageAdjustment;
+
+// Applies the lookup table on a worker thread into a copy of the image, one tile at a time;
+// the render loop uploads only the tiles whose pixels changed
+typedef struct {
+    const SDL_Surface* source; // Retained ARGB8888 copy of the base image
+    Uint32* output;            // Adjusted pixels, width * height
+    SDL_Texture* texture;      // Streaming texture showing output
+    int tile_columns;
+    int tile_rows;
+    bool* tile_dirty;          // Tile changed since its last upload; guarded by lock, as are writes to output
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* changed;
+    ImageAdjustment requested; // Guarded by lock
+    unsigned int generation;   // Bumped for every request; the worker restarts when it moves
+    bool stop;
+    bool failed;               // Starting failed; adjustments fall back to gain only
+} ImageAdjuster;
+
+// Per-channel histograms of the base image, computed on a background thread after the
+// first frame is shown; counts are only read once ready is set
+typedef struct {
+    const SDL_Surface* source;
+    Uint32 counts[3][256]; // Red, green, blue
+    SDL_Thread* thread;
+    bool started;          // The pass has run or is running, on the thread or inline
+    SDL_atomic_t ready;
+} Histogram;
+
+// Sobel gradient magnitude of the base image, computed per tile the first time a click
+// lands near it and kept for later clicks
+typedef struct {
+    const SDL_Surface* source;
+    int tile_columns;
+    int tile_rows;
+    Uint16** tiles; // EDGE_TILE_SIZE^2 magnitudes per tile, NULL until needed
+} EdgeMap;
+
+// Heads-up display in the window's top-left corner
+typedef struct {
+    bool enabled;
+    bool has_cursor; // Cursor is over the image
+    int cursor_x;    // Image pixel under the cursor
+    int cursor_y;
+} Hud;
+
+// Connections accepted by the render server, waiting for a worker
+typedef struct {
+    int* fds; // Ring of SERVER_QUEUE_SIZE
+    int head;
+    int count;
+    bool stop; // No more connections; workers exit once the queue is empty
+    SDL_mutex* lock;
+    SDL_cond* changed;
+} JobQueue;
+
+typedef void (*CacheFreeValue)(void* value);
+
+// A cached value for one file version. Entries are allocated individually so jobs can hold
+// them while the cache's array changes.
+typedef struct {
+    char* path;
+    time_t mtime;
+    off_t file_size;
+    void* value;
+    size_t bytes;
+    int references; // Jobs using the value; it is only freed once this drops to zero
+    bool stale;     // Evicted or replaced while in use; freed on the last release
+    Uint64 last_used;
+} CacheEntry;
+
+// Memory-budgeted LRU cache keyed by path and modification time, shared by the render
+// server's workers. Eviction scans for the least recently used entry no job is holding;
+// the caches hold tens of entries, so a scan costs far less than the load it saves.
+typedef struct {
+    const char* name;
+    CacheEntry** entries;
+    int count;
+    int capacity;
+    size_t bytes;
+    size_t budget;
+    Uint64 clock;
+    Uint64 hits;
+    Uint64 misses;
+    Uint64 evictions;
+    CacheFreeValue free_value;
+    SDL_mutex* lock;
+} LruCache;
+
+// A render server worker keeps its font open between jobs; decoded images and parsed
+// drawings come from caches shared by all workers
+typedef struct {
+    JobQueue* queue;
+    LruCache* images;   // SDL_Surface*, ARGB8888
+    LruCache* drawings; // Drawing*, parsed from .vd files
+    int index;
+    TTF_Font* font;     // SDL_ttf fonts must not be shared between threads
+    SDL_Thread* thread;
+} RenderWorker;
+
+// One request to the render server; see run_server for the protocol
+typedef struct {
+    char* image_path;
+    char* drawing_path;
+    char* filter;
+    char* output_path;
+    char* format;         // png, bmp, ppm or svg; defaults to the output file's extension
+    char* inline_drawing; // .vd text sent after the header
+    size_t inline_length;
+    bool stats_only;      // command=stats: report cache metrics instead of rendering
+} RenderJob;
+
 // --- Constants ---
-#define MAX_DRAW_ELEMENTS 500
 #define HASH_TABLE_SIZE 1000
+#define LINE_SET_EMPTY UINT64_MAX
+#define MAX_WORKERS 64
+#define SERVER_QUEUE_SIZE 64
+#define SERVER_READ_TIMEOUT 30            // Seconds a client may stall while sending a request
+#define SERVER_MAX_INLINE_DRAWING (1 << 28)
+#define MAX_DIAGNOSTICS 1000 // Further diagnostics are only counted
+#define READ_CHUNK_SIZE (1 << 20)
+#define MAX_RECORD_LENGTH 4096
+#define MAX_JSON_DEPTH 64
+#define MAX_ATTRIBUTES 32 // Per record
+#define FILTER_BATCH 1024
+#define MAX_FILTER_DEPTH 64
+#define HEATMAP_POINTS_PER_WORKER 65536 // Each worker has a full-size histogram, so keep them busy
+#define HEATMAP_PARTIAL_BUDGET ((size_t)256 << 20) // Bytes of per-worker histograms per rebuild
+#define MAX_BLUR_RADIUS 64
+#define POINT_CLOUD_BATCH 1024
+#define MIN_ZOOM 0.125
+#define MAX_ZOOM 64.0
+#define MINIMAP_SIZE 192 // Longest side of the minimap pane
+#define MAX_PANES 2
+#define FLICKER_INTERVAL_MS 500
+#define ADJUST_TILE_SIZE 256
+#define HISTOGRAM_HEIGHT 64
+#define EDGE_TILE_SIZE 64
+#define SNAP_RADIUS 10        // Screen pixels searched around a click
+#define SNAP_MIN_GRADIENT 96  // Weaker maxima leave the click where it is
+#define AUTO_CONTRAST_CLIP 0.005 // Fraction of pixels clipped at each end by auto-contrast
+#define WRITER_BUFFER_SIZE (1 << 16)
 int SCREEN_WIDTH = 800;
 int SCREEN_HEIGHT = 600;
 const SDL_Color COLOR_BLACK = {0, 0, 0, 255};
@@ -51,325 +579,4407 @@ const SDL_Color COLOR_WHITE_BG = {255, 255, 255, 255};
 const int DRAW_LINE_THICKNESS = 10; // Increased for visibility
 const int DRAW_POINT_RADIUS = 4;
 const int FONT_SIZE = 12;
+const char* FONT_PATH = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
 
 // --- Function Prototypes ---
 bool save_screenshot(SDL_Renderer* renderer, int width, int height, const char* filename);
 
 // --- Hash Table Functions ---
-unsigned int hash(const char* str) {
+unsigned int hash(const char* str, int size) {
     unsigned int h = 0;
     for (int i = 0; str[i]; i++) {
         h = 31 * h + str[i];
     }
-    return h % HASH_TABLE_SIZE;
+    return h % size;
 }
 
 HashTable* create_hash_table() {
     HashTable* table = malloc(sizeof(HashTable));
     table->size = HASH_TABLE_SIZE;
+    table->count = 0;
+    table->tombstones = 0;
     table->entries = calloc(HASH_TABLE_SIZE, sizeof(HashEntry));
     return table;
 }
 
-void hash_table_insert(HashTable* table, const char* label, Point point) {
-    unsigned int index = hash(label);
-    while (table->entries[index].used) {
-        index = (index + 1) % HASH_TABLE_SIZE;
-    }
-    table->entries[index].used = true;
-    table->entries[index].label = strdup(label);
-    table->entries[index].point = point;
+// Rebuilds the probe chains at new_size without tombstones. Live entries are moved, not
+// copied, so label pointers held elsewhere (e.g. by the loaded points array) stay valid.
+void hash_table_rehash(HashTable* table, int new_size) {
+    HashEntry* old_entries = table->entries;
+    int old_size = table->size;
+    table->entries = calloc(new_size, sizeof(HashEntry));
+    table->size = new_size;
+    for (int i = 0; i < old_size; i++) {
+        if (!old_entries[i].used || old_entries[i].deleted) continue;
+        unsigned int index = hash(old_entries[i].label, new_size);
+        while (table->entries[index].used) {
+            index = (index + 1) % new_size;
+        }
+        table->entries[index] = old_entries[i];
+    }
+    free(old_entries);
+    table->tombstones = 0;
+}
+
+// Upsert in a single probe. Returns the live entry for label; *duplicate tells whether
+// it already existed, in which case the policy decides if the stored point is replaced.
+// New entries own copies of the label for both the key and the stored point.
+HashEntry* hash_table_insert(HashTable* table, const char* label, Point point, int index, DuplicatePolicy policy, bool* duplicate) {
+    if ((table->count + table->tombstones + 1) * 2 > table->size) {
+        hash_table_rehash(table, table->size * 2); // Keep the load factor under one half
+    }
+    unsigned int index_in_table = hash(label, table->size);
+    HashEntry* free_slot = NULL;
+    while (table->entries[index_in_table].used) {
+        HashEntry* entry = &table->entries[index_in_table];
+        if (entry->deleted) {
+            if (!free_slot) free_slot = entry; // Remember the first tombstone for reuse
+        } else if (strcmp(entry->label, label) == 0) {
+            *duplicate = true;
+            if (policy == DUPLICATE_LAST_WINS) {
+                entry->point.x = point.x;
+                entry->point.y = point.y;
+                entry->point.time = point.time;
+            }
+            return entry;
+        }
+        index_in_table = (index_in_table + 1) % table->size;
+    }
+    if (free_slot) {
+        table->tombstones--;
+    } else {
+        free_slot = &table->entries[index_in_table];
+    }
+    *duplicate = false;
+    free_slot->used = true;
+    free_slot->deleted = false;
+    free_slot->label = strdup(label);
+    free_slot->point = point;
+    free_slot->point.label = strdup(label);
+    free_slot->index = index;
+    table->count++;
+    return free_slot;
+}
+
+HashEntry* hash_table_find_entry(HashTable* table, const char* label) {
+    unsigned int index = hash(label, table->size);
+    int attempts = 0;
+    while (table->entries[index].used && attempts < table->size) {
+        if (!table->entries[index].deleted && strcmp(table->entries[index].label, label) == 0) {
+            return &table->entries[index];
+        }
+        index = (index + 1) % table->size;
+        attempts++;
+    }
+    return NULL;
+}
+
+Point* hash_table_get(HashTable* table, const char* label) {
+    HashEntry* entry = hash_table_find_entry(table, label);
+    return entry ? &entry->point : NULL;
+}
+
+// Removes a label, leaving a tombstone so later entries in the same probe chain
+// remain reachable. Frees the entry's label and the point label it owns.
+bool hash_table_delete(HashTable* table, const char* label) {
+    HashEntry* entry = hash_table_find_entry(table, label);
+    if (!entry) return false;
+    free(entry->label);
+    free(entry->point.label);
+    entry->label = NULL;
+    entry->point.label = NULL;
+    entry->deleted = true;
+    table->count--;
+    table->tombstones++;
+    if (table->tombstones > table->size / 4) {
+        hash_table_rehash(table, table->size); // Compact in place
+    }
+    return true;
+}
+
+void free_hash_table(HashTable* table) {
+    for (int i = 0; i < table->size; i++) {
+        if (table->entries[i].used && !table->entries[i].deleted) {
+            free(table->entries[i].label);
+            free(table->entries[i].point.label);
+        }
+    }
+    free(table->entries);
+    free(table);
+}
+
+// --- Line Set Functions ---
+void line_set_init(LineSet* set, int size) {
+    set->size = size;
+    set->count = 0;
+    set->keys = malloc(size * sizeof(uint64_t));
+    for (int i = 0; i < size; i++) set->keys[i] = LINE_SET_EMPTY;
+}
+
+void line_set_free(LineSet* set) {
+    free(set->keys);
+    set->keys = NULL;
+}
+
+// Endpoints are ordered so line(a,b) and line(b,a) map to the same key
+uint64_t line_key(int index1, int index2) {
+    uint32_t lo = index1 < index2 ? index1 : index2;
+    uint32_t hi = index1 < index2 ? index2 : index1;
+    return ((uint64_t)lo << 32) | hi;
+}
+
+// Returns false if the key was already present
+bool line_set_add(LineSet* set, uint64_t key) {
+    if ((set->count + 1) * 2 > set->size) {
+        LineSet grown;
+        line_set_init(&grown, set->size * 2);
+        for (int i = 0; i < set->size; i++) {
+            if (set->keys[i] != LINE_SET_EMPTY) line_set_add(&grown, set->keys[i]);
+        }
+        line_set_free(set);
+        *set = grown;
+    }
+    unsigned int index = (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32) & (set->size - 1);
+    while (set->keys[index] != LINE_SET_EMPTY) {
+        if (set->keys[index] == key) return false;
+        index = (index + 1) & (set->size - 1);
+    }
+    set->keys[index] = key;
+    set->count++;
+    return true;
+}
+
+// --- Parallel Helpers ---
+typedef void (*ParallelTask)(void* context, int worker, int begin, int end);
+
+typedef struct {
+    ParallelTask task;
+    void* context;
+    int worker;
+    int begin;
+    int end;
+} ParallelJob;
+
+int parallel_job_thread(void* data) {
+    ParallelJob* job = data;
+    job->task(job->context, job->worker, job->begin, job->end);
+    return 0;
+}
+
+// Number of workers parallel_for uses for count items; size per-worker partials with this
+int parallel_worker_count(int count, int min_chunk) {
+    int workers = SDL_GetCPUCount();
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+    if (workers > count / min_chunk) workers = count / min_chunk;
+    return workers < 1 ? 1 : workers;
+}
+
+// Splits [0, count) into one contiguous range per worker and runs task on each. The calling
+// thread takes the last range. SDL threads work without SDL_Init, so headless modes can use this.
+void parallel_for(int count, int min_chunk, ParallelTask task, void* context) {
+    int workers = parallel_worker_count(count, min_chunk);
+    ParallelJob jobs[MAX_WORKERS];
+    SDL_Thread* threads[MAX_WORKERS];
+    for (int w = 0; w < workers; ++w) {
+        jobs[w].task = task;
+        jobs[w].context = context;
+        jobs[w].worker = w;
+        jobs[w].begin = (int)((int64_t)count * w / workers);
+        jobs[w].end = (int)((int64_t)count * (w + 1) / workers);
+    }
+    for (int w = 0; w < workers - 1; ++w) {
+        threads[w] = SDL_CreateThread(parallel_job_thread, "worker", &jobs[w]);
+        if (!threads[w]) parallel_job_thread(&jobs[w]); // Run inline if the thread can't start
+    }
+    parallel_job_thread(&jobs[workers - 1]);
+    for (int w = 0; w < workers - 1; ++w) {
+        if (threads[w]) SDL_WaitThread(threads[w], NULL);
+    }
+}
+
+// --- Drawing Functions ---
+void set_draw_color(SDL_Renderer* renderer, SDL_Color color) {
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+}
+
+void draw_filled_circle(SDL_Renderer* renderer, int cx, int cy, int radius, SDL_Color color) {
+    set_draw_color(renderer, color);
+    for (int y = -radius; y <= radius; y++) {
+        float x_squared = radius * radius - y * y;
+        if (x_squared < 0) x_squared = 0;
+        int x_span = sqrt(x_squared);
+        SDL_RenderDrawLine(renderer, cx - x_span, cy + y, cx + x_span, cy + y);
+    }
+}
+
+void draw_text(SDL_Renderer* renderer, TTF_Font* font, const char* text, int x, int y, SDL_Color color) {
+    if (!font || !text || text[0] == '\0') return;
+    SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, color);
+    if (!textSurface) {
+        fprintf(stderr, "Unable to render text surface! TTF_Error: %s\n", TTF_GetError());
+        return;
+    }
+    SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
+    if (textTexture) {
+        int textW, textH;
+        SDL_QueryTexture(textTexture, NULL, NULL, &textW, &textH);
+        SDL_Rect backgroundRect = {x, y, textW, textH};
+        set_draw_color(renderer, COLOR_WHITE_BG);
+        SDL_RenderFillRect(renderer, &backgroundRect);
+        SDL_Rect renderQuad = {x, y, textW, textH};
+        SDL_RenderCopy(renderer, textTexture, NULL, &renderQuad);
+        SDL_DestroyTexture(textTexture);
+    }
+    SDL_FreeSurface(textSurface);
+}
+
+void draw_point_with_label(SDL_Renderer* renderer, Point point, int radius, SDL_Color color, TTF_Font* font) {
+    draw_filled_circle(renderer, point.x, point.y, radius, color);
+    if (point.label) {
+        int label_x_offset = radius + 5;
+        int label_y_offset = -radius;
+        draw_text(renderer, font, point.label, point.x + label_x_offset, point.y + label_y_offset, color);
+    }
+}
+
+// --- Viewport Functions ---
+void viewport_to_screen(const Viewport* view, double x, double y, int* screen_x, int* screen_y) {
+    *screen_x = (int)lround((x - view->x) * view->zoom);
+    *screen_y = (int)lround((y - view->y) * view->zoom);
+}
+
+void viewport_to_image(const Viewport* view, int screen_x, int screen_y, double* x, double* y) {
+    *x = view->x + screen_x / view->zoom;
+    *y = view->y + screen_y / view->zoom;
+}
+
+// Screen rectangle covered by an image-sized texture
+SDL_Rect viewport_image_rect(const Viewport* view, int image_width, int image_height) {
+    int x, y;
+    viewport_to_screen(view, 0, 0, &x, &y);
+    SDL_Rect rect = {x, y, (int)lround(image_width * view->zoom), (int)lround(image_height * view->zoom)};
+    return rect;
+}
+
+// Zooms by factor while keeping the image point under (screen_x, screen_y) in place
+void viewport_zoom_at(Viewport* view, double factor, int screen_x, int screen_y) {
+    double x, y;
+    viewport_to_image(view, screen_x, screen_y, &x, &y);
+    view->zoom *= factor;
+    if (view->zoom < MIN_ZOOM) view->zoom = MIN_ZOOM;
+    if (view->zoom > MAX_ZOOM) view->zoom = MAX_ZOOM;
+    view->x = x - screen_x / view->zoom;
+    view->y = y - screen_y / view->zoom;
+}
+
+void viewport_center_on(Viewport* view, double x, double y) {
+    view->x = x - view->pane.w / 2.0 / view->zoom;
+    view->y = y - view->pane.h / 2.0 / view->zoom;
+}
+
+// True when part of the image lies outside the pane
+bool viewport_is_partial(const Viewport* view, int image_width, int image_height) {
+    return view->x > 0 || view->y > 0 || view->x + view->pane.w / view->zoom < image_width ||
+           view->y + view->pane.h / view->zoom < image_height;
+}
+
+// Index of the view whose pane contains the window point, or -1
+int viewport_at(const Viewport* views, int view_count, int window_x, int window_y) {
+    SDL_Point point = {window_x, window_y};
+    for (int i = 0; i < view_count; ++i) {
+        if (SDL_PointInRect(&point, &views[i].pane)) return i;
+    }
+    return -1;
+}
+
+// Culls a screen-space segment that lies entirely off one side of the window
+bool segment_on_screen(int x1, int y1, int x2, int y2, int width, int height, int margin) {
+    if ((x1 < -margin && x2 < -margin) || (y1 < -margin && y2 < -margin)) return false;
+    if ((x1 > width + margin && x2 > width + margin) || (y1 > height + margin && y2 > height + margin)) return false;
+    return true;
+}
+
+// --- Drawing Functions (continued) ---
+void draw_thick_line(SDL_Renderer* renderer, Line line, int thickness, SDL_Color color, HashTable* point_table, const Viewport* view) {
+    Point* p1 = hash_table_get(point_table, line.label1);
+    Point* p2 = hash_table_get(point_table, line.label2);
+    if (!p1 || !p2) {
+        fprintf(stderr, "Warning: Line references undefined points: %s, %s\n", line.label1, line.label2);
+        return;
+    }
+
+    // Removed repeated printf to avoid console flooding
+    // Use single line rendering for testing visibility
+    int x1, y1, x2, y2;
+    viewport_to_screen(view, p1->x, p1->y, &x1, &y1);
+    viewport_to_screen(view, p2->x, p2->y, &x2, &y2);
+    if (!segment_on_screen(x1, y1, x2, y2, view->pane.w, view->pane.h, thickness)) return;
+    set_draw_color(renderer, color);
+    SDL_RenderDrawLine(renderer, x1, y1, x2, y2); // Simplified to single line
+
+    /* Original thick line code (commented out for testing)
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float length = sqrt(dx*dx + dy*dy);
+
+    if (length == 0) {
+        for (int i = -thickness/2; i <= thickness/2; ++i) {
+            for (int j = -thickness/2; j <= thickness/2; ++j) {
+                SDL_RenderDrawPoint(renderer, x1 + i, y1 + j);
+            }
+        }
+        return;
+    }
+
+    float nx = -dy / length;
+    float ny = dx / length;
+    for (int i = -thickness / 2; i <= thickness / 2; ++i) {
+        SDL_RenderDrawLine(renderer, x1 + (int)(i * nx), y1 + (int)(i * ny), x2 + (int)(i * nx), y2 + (int)(i * ny));
+    }
+    */
+}
+
+// --- Drawing Data Functions ---
+void drawing_init(Drawing* drawing) {
+    memset(drawing, 0, sizeof(Drawing));
+    drawing->point_table = create_hash_table();
+}
+
+void attribute_column_resize(AttributeColumn* column, int capacity) {
+    if (column->type == ATTRIBUTE_NUMBER) {
+        column->numbers = realloc(column->numbers, capacity * sizeof(double));
+    } else {
+        column->codes = realloc(column->codes, capacity * sizeof(int));
+    }
+}
+
+void drawing_clear_attributes(Drawing* drawing, int row) {
+    for (int i = 0; i < drawing->column_count; ++i) {
+        AttributeColumn* column = &drawing->columns[i];
+        if (column->type == ATTRIBUTE_NUMBER) {
+            column->numbers[row] = NAN;
+        } else {
+            column->codes[row] = -1;
+        }
+    }
+}
+
+int drawing_find_column(const Drawing* drawing, const char* key) {
+    for (int i = 0; i < drawing->column_count; ++i) {
+        if (strcmp(drawing->columns[i].key, key) == 0) return i;
+    }
+    return -1;
+}
+
+// Stores key=value for the point at row, creating the column on first use. Returns false
+// when a non-numeric value is given for a numeric column.
+bool drawing_set_attribute(Drawing* drawing, int row, const char* key, const char* value) {
+    char* end;
+    double number = strtod(value, &end);
+    bool numeric = end != value && *end == '\0' && !isnan(number);
+    int index = drawing_find_column(drawing, key);
+    if (index < 0) {
+        drawing->columns = realloc(drawing->columns, (drawing->column_count + 1) * sizeof(AttributeColumn));
+        AttributeColumn* column = &drawing->columns[drawing->column_count];
+        memset(column, 0, sizeof(AttributeColumn));
+        column->key = strdup(key);
+        column->type = numeric ? ATTRIBUTE_NUMBER : ATTRIBUTE_STRING;
+        if (!numeric) column->dictionary = create_hash_table();
+        attribute_column_resize(column, drawing->point_capacity);
+        for (int i = 0; i < drawing->point_count; ++i) {
+            if (numeric) column->numbers[i] = NAN;
+            else column->codes[i] = -1;
+        }
+        index = drawing->column_count++;
+    }
+    AttributeColumn* column = &drawing->columns[index];
+    if (column->type == ATTRIBUTE_NUMBER) {
+        if (!numeric) return false;
+        column->numbers[row] = number;
+        return true;
+    }
+    bool duplicate;
+    Point unused = {0, 0, NULL, NAN};
+    HashEntry* entry = hash_table_insert(column->dictionary, value, unused, column->value_count, DUPLICATE_FIRST_WINS, &duplicate);
+    if (!duplicate) {
+        column->values = realloc(column->values, (column->value_count + 1) * sizeof(char*));
+        column->values[column->value_count++] = entry->label;
+    }
+    column->codes[row] = entry->index;
+    return true;
+}
+
+// The point's label is owned by the point table
+void drawing_append_point(Drawing* drawing, Point point) {
+    if (drawing->point_count == drawing->point_capacity) {
+        drawing->point_capacity = drawing->point_capacity ? drawing->point_capacity * 2 : 256;
+        drawing->points = realloc(drawing->points, drawing->point_capacity * sizeof(Point));
+        drawing->point_flags = realloc(drawing->point_flags, drawing->point_capacity);
+        for (int i = 0; i < drawing->column_count; ++i) {
+            attribute_column_resize(&drawing->columns[i], drawing->point_capacity);
+        }
+    }
+    drawing->point_flags[drawing->point_count] = 0;
+    drawing_clear_attributes(drawing, drawing->point_count);
+    drawing->points[drawing->point_count++] = point;
+    drawing->revision++;
+}
+
+void drawing_append_line(Drawing* drawing, const char* label1, const char* label2) {
+    if (drawing->line_count == drawing->line_capacity) {
+        drawing->line_capacity = drawing->line_capacity ? drawing->line_capacity * 2 : 256;
+        drawing->lines = realloc(drawing->lines, drawing->line_capacity * sizeof(Line));
+    }
+    drawing->lines[drawing->line_count].label1 = strdup(label1);
+    drawing->lines[drawing->line_count].label2 = strdup(label2);
+    drawing->line_count++;
+    drawing->revision++;
+}
+
+void free_drawing(Drawing* drawing) {
+    for (int i = 0; i < drawing->line_count; ++i) {
+        free(drawing->lines[i].label1);
+        free(drawing->lines[i].label2);
+    }
+    free(drawing->lines);
+    free(drawing->points); // Point labels are freed with the hash table
+    free(drawing->point_flags);
+    free(drawing->time_index);
+    for (int i = 0; i < drawing->column_count; ++i) {
+        AttributeColumn* column = &drawing->columns[i];
+        free(column->key);
+        free(column->numbers);
+        free(column->codes);
+        free(column->values); // Value strings are owned by the dictionary
+        if (column->dictionary) free_hash_table(column->dictionary);
+    }
+    free(drawing->columns);
+    free_hash_table(drawing->point_table);
+    free(drawing->stats.diagnostics);
+    for (int i = 0; i < drawing->source_count; ++i) {
+        free(drawing->sources[i]);
+    }
+    free(drawing->sources);
+    line_set_free(&drawing->seen_lines);
+    memset(drawing, 0, sizeof(Drawing));
+}
+
+// A line is drawn only when both endpoints are
+bool line_is_visible(const Drawing* drawing, Line line) {
+    HashEntry* entry1 = hash_table_find_entry(drawing->point_table, line.label1);
+    HashEntry* entry2 = hash_table_find_entry(drawing->point_table, line.label2);
+    return entry1 && entry2 && !drawing->point_flags[entry1->index] && !drawing->point_flags[entry2->index];
+}
+
+// --- Input Functions ---
+int inflate_thread(void* data) {
+    ChunkReader* reader = data;
+    for (int i = 0;; i ^= 1) {
+        SDL_LockMutex(reader->lock);
+        while (reader->filled[i] && !reader->stop) {
+            SDL_CondWait(reader->changed, reader->lock);
+        }
+        bool stop = reader->stop;
+        SDL_UnlockMutex(reader->lock);
+        if (stop) break;
+
+        int length = gzread(reader->gz, reader->chunks[i], READ_CHUNK_SIZE);
+        int gz_status = Z_OK;
+        if (length <= 0) gzerror(reader->gz, &gz_status); // Truncated streams end with Z_BUF_ERROR
+        SDL_LockMutex(reader->lock);
+        reader->lengths[i] = length > 0 ? length : 0;
+        reader->filled[i] = true;
+        if (length < 0 || gz_status != Z_OK) reader->failed = true;
+        SDL_CondSignal(reader->changed);
+        SDL_UnlockMutex(reader->lock);
+        if (length <= 0) break; // End of input; the empty chunk tells the consumer
+    }
+    return 0;
+}
+
+void chunk_reader_close(ChunkReader* reader) {
+    if (reader->thread) {
+        SDL_LockMutex(reader->lock);
+        reader->stop = true;
+        SDL_CondSignal(reader->changed);
+        SDL_UnlockMutex(reader->lock);
+        SDL_WaitThread(reader->thread, NULL);
+    }
+    if (reader->lock) SDL_DestroyMutex(reader->lock);
+    if (reader->changed) SDL_DestroyCond(reader->changed);
+    if (reader->gz) gzclose(reader->gz);
+    if (reader->file) fclose(reader->file);
+    free(reader->chunks[0]);
+    free(reader->chunks[1]);
+    free(reader->line);
+    memset(reader, 0, sizeof(ChunkReader));
+}
+
+// Opens path for chunked reading, detecting gzip input by its magic bytes
+bool chunk_reader_open(ChunkReader* reader, const char* path) {
+    memset(reader, 0, sizeof(ChunkReader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) return false;
+    unsigned char magic[2] = {0, 0};
+    bool compressed = fread(magic, 1, 2, reader->file) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    rewind(reader->file);
+
+    reader->chunks[0] = malloc(READ_CHUNK_SIZE);
+    reader->line = malloc(MAX_RECORD_LENGTH + 1);
+    if (!compressed) return true;
+
+    fclose(reader->file);
+    reader->file = NULL;
+    reader->gz = gzopen(path, "rb");
+    if (!reader->gz) {
+        chunk_reader_close(reader);
+        return false;
+    }
+    gzbuffer(reader->gz, 256 * 1024);
+    reader->chunks[1] = malloc(READ_CHUNK_SIZE);
+    reader->lock = SDL_CreateMutex();
+    reader->changed = SDL_CreateCond();
+    reader->thread = SDL_CreateThread(inflate_thread, "inflate", reader);
+    if (!reader->thread) {
+        chunk_reader_close(reader); // Callers don't close a reader that failed to open
+        return false;
+    }
+    return true;
+}
+
+// Moves to the next chunk. Returns false at end of input.
+bool chunk_reader_advance(ChunkReader* reader) {
+    reader->chunk_offset += reader->length;
+    reader->position = 0;
+    reader->length = 0;
+    if (reader->finished) return false;
+    if (reader->file) {
+        reader->length = (int)fread(reader->chunks[0], 1, READ_CHUNK_SIZE, reader->file);
+        reader->data = reader->chunks[0];
+        if (ferror(reader->file)) reader->failed = true;
+        reader->finished = reader->length == 0;
+        return !reader->finished;
+    }
+    if (!reader->thread) {
+        reader->finished = true;
+        return false;
+    }
+    SDL_LockMutex(reader->lock);
+    if (reader->holding) {
+        reader->filled[reader->current] = false; // Hand the chunk back to the inflate thread
+        reader->current ^= 1;
+        SDL_CondSignal(reader->changed);
+    }
+    while (!reader->filled[reader->current]) {
+        SDL_CondWait(reader->changed, reader->lock);
+    }
+    reader->holding = true;
+    reader->data = reader->chunks[reader->current];
+    reader->length = reader->lengths[reader->current];
+    SDL_UnlockMutex(reader->lock);
+    reader->finished = reader->length == 0; // The inflate thread has exited
+    return !reader->finished;
+}
+
+// Returns the next line without its terminator, or NULL at end of input. The pointer stays
+// valid until the next call. Lines inside one chunk are returned in place; lines spanning
+// chunks are assembled. Lines over MAX_RECORD_LENGTH come back truncated with *too_long set.
+char* chunk_reader_getline(ChunkReader* reader, int64_t* offset, bool* too_long) {
+    int assembled = 0;
+    bool started = false;
+    *too_long = false;
+    for (;;) {
+        if (reader->position >= reader->length) {
+            if (!chunk_reader_advance(reader)) {
+                if (!started) return NULL;
+                break; // Last line has no terminator
+            }
+        }
+        char* start = reader->data + reader->position;
+        int available = reader->length - reader->position;
+        char* newline = memchr(start, '\n', available);
+        int segment = newline ? (int)(newline - start) : available;
+        if (!started) *offset = reader->chunk_offset + reader->position;
+        started = true;
+        reader->position += segment + (newline ? 1 : 0);
+
+        if (newline && assembled == 0 && segment <= MAX_RECORD_LENGTH) {
+            if (segment > 0 && start[segment - 1] == '\r') segment--;
+            start[segment] = '\0';
+            return start;
+        }
+        int copy = segment < MAX_RECORD_LENGTH - assembled ? segment : MAX_RECORD_LENGTH - assembled;
+        if (copy < segment) *too_long = true;
+        memcpy(reader->line + assembled, start, copy);
+        assembled += copy;
+        if (newline) break;
+    }
+    if (assembled > 0 && reader->line[assembled - 1] == '\r') assembled--;
+    reader->line[assembled] = '\0';
+    return reader->line;
+}
+
+// --- Parse Function ---
+const char* diagnostic_message(DiagnosticKind kind) {
+    switch (kind) {
+        case DIAG_OPEN_FAILED: return "could not open drawing file";
+        case DIAG_POINT_SYNTAX: return "point record must be point(x,y,label)";
+        case DIAG_POINT_BAD_X: return "point record has invalid x coordinate";
+        case DIAG_POINT_BAD_Y: return "point record has invalid y coordinate";
+        case DIAG_POINT_MISSING_LABEL: return "point missing required label";
+        case DIAG_POINT_BAD_TIME: return "point record has invalid time";
+        case DIAG_POINT_BAD_ATTRIBUTE: return "point attribute must be key=value";
+        case DIAG_ATTRIBUTE_TYPE: return "attribute value is not a number like the rest of its column";
+        case DIAG_DUPLICATE_LABEL: return "duplicate point label";
+        case DIAG_LINE_SYNTAX: return "line record must be line(label1,label2)";
+        case DIAG_LINE_MISSING_LABEL: return "line missing valid labels";
+        case DIAG_UNDEFINED_POINT: return "line references undefined point";
+        case DIAG_RECORD_TOO_LONG: return "record too long";
+        case DIAG_READ_FAILED: return "read failed (corrupt compressed data?)";
+        case DIAG_CSV_FIELD_COUNT: return "wrong number of CSV fields";
+        case DIAG_CSV_EMPTY_HEADER: return "CSV header has an empty column name";
+        case DIAG_JSON_SYNTAX: return "invalid JSON";
+        case DIAG_JSON_GEOMETRY: return "unsupported or malformed geometry";
+        default: return "unknown problem";
+    }
+}
+
+const char* diagnostic_kind_name(DiagnosticKind kind) {
+    static const char* names[DIAG_KIND_COUNT] = {
+        "open_failed", "point_syntax", "point_bad_x", "point_bad_y", "point_missing_label", "point_bad_time",
+        "point_bad_attribute", "attribute_type",
+        "duplicate_label", "line_syntax", "line_missing_label", "undefined_point",
+        "record_too_long", "read_failed", "csv_field_count", "csv_empty_header",
+        "json_syntax", "json_geometry"
+    };
+    return kind < DIAG_KIND_COUNT ? names[kind] : "unknown";
+}
+
+bool diagnostic_is_error(DiagnosticKind kind) {
+    return kind != DIAG_UNDEFINED_POINT;
+}
+
+// Orders by input file, then position in the file
+int compare_diagnostics(const void* a, const void* b) {
+    const Diagnostic* diagnostic_a = a;
+    const Diagnostic* diagnostic_b = b;
+    if (diagnostic_a->source != diagnostic_b->source) return diagnostic_a->source - diagnostic_b->source;
+    return (diagnostic_a->byte_offset > diagnostic_b->byte_offset) - (diagnostic_a->byte_offset < diagnostic_b->byte_offset);
+}
+
+// Moves heap[index] down until no child is later than it
+void diagnostic_sift_down(Diagnostic* heap, int count, int index) {
+    for (;;) {
+        int latest = index, left = 2 * index + 1, right = left + 1;
+        if (left < count && compare_diagnostics(&heap[left], &heap[latest]) > 0) latest = left;
+        if (right < count && compare_diagnostics(&heap[right], &heap[latest]) > 0) latest = right;
+        if (latest == index) return;
+        Diagnostic swap = heap[index];
+        heap[index] = heap[latest];
+        heap[latest] = swap;
+        index = latest;
+    }
+}
+
+// Records a diagnostic without printing it. Past MAX_DIAGNOSTICS the totals still grow and
+// only the earliest are kept: reference checks report after the pass, so a late report can
+// still come before stored ones in the file.
+void report_diagnostic(LoadStats* stats, DiagnosticKind kind, int source, int line_number, int64_t byte_offset) {
+    if (diagnostic_is_error(kind)) {
+        stats->errors++;
+    } else {
+        stats->warnings++;
+    }
+    if (!stats->diagnostics) {
+        stats->diagnostics = malloc(MAX_DIAGNOSTICS * sizeof(Diagnostic));
+    }
+    Diagnostic diagnostic = {kind, source, line_number, byte_offset};
+    if (stats->diagnostic_count < MAX_DIAGNOSTICS) {
+        stats->diagnostics[stats->diagnostic_count++] = diagnostic;
+        return;
+    }
+    if (!stats->diagnostics_heap) {
+        for (int i = MAX_DIAGNOSTICS / 2 - 1; i >= 0; --i) diagnostic_sift_down(stats->diagnostics, MAX_DIAGNOSTICS, i);
+        stats->diagnostics_heap = true;
+    }
+    if (compare_diagnostics(&diagnostic, &stats->diagnostics[0]) >= 0) return; // Later than everything kept
+    stats->diagnostics[0] = diagnostic;
+    diagnostic_sift_down(stats->diagnostics, MAX_DIAGNOSTICS, 0);
+}
+
+// Puts stored diagnostics back in file order
+void sort_diagnostics(LoadStats* stats) {
+    if (stats->diagnostic_count > 0) qsort(stats->diagnostics, stats->diagnostic_count, sizeof(Diagnostic), compare_diagnostics);
+    stats->diagnostics_heap = false;
+}
+
+// Prints stored diagnostics as "file:line: severity: message (byte N)"
+void print_diagnostics(FILE* out, const Drawing* drawing) {
+    const LoadStats* stats = &drawing->stats;
+    for (int i = 0; i < stats->diagnostic_count; ++i) {
+        const Diagnostic* diagnostic = &stats->diagnostics[i];
+        fprintf(out, "%s:%d: %s: %s (byte %lld)\n", drawing->sources[diagnostic->source], diagnostic->line_number,
+                diagnostic_is_error(diagnostic->kind) ? "error" : "warning",
+                diagnostic_message(diagnostic->kind), (long long)diagnostic->byte_offset);
+    }
+    int total = stats->errors + stats->warnings;
+    if (total > stats->diagnostic_count) {
+        fprintf(out, "%d more diagnostics not shown\n", total - stats->diagnostic_count);
+    }
+}
+
+char* trim_whitespace(char* text) {
+    while (isspace((unsigned char)*text)) text++;
+    char* end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return text;
+}
+
+// Where a line record came from, kept until references are resolved after the pass
+typedef struct {
+    int line_number;
+    int64_t byte_offset;
+} LineOrigin;
+
+// Per-file state shared by the importers (.vd, CSV), so every format feeds the same
+// point table, duplicate policy, line resolution and diagnostics
+typedef struct {
+    Drawing* drawing;
+    const LoadOptions* options;
+    int source;          // Index into drawing->sources
+    int line_number;     // Current record
+    int64_t byte_offset;
+    int first_line;      // First line appended from this file
+    LineOrigin* origins; // Origin of each line appended from this file
+    int origin_capacity;
+} Loader;
+
+void loader_begin(Loader* loader, Drawing* drawing, const LoadOptions* options, const char* filepath) {
+    memset(loader, 0, sizeof(Loader));
+    loader->drawing = drawing;
+    loader->options = options;
+    loader->first_line = drawing->line_count;
+    drawing->sources = realloc(drawing->sources, (drawing->source_count + 1) * sizeof(char*));
+    drawing->sources[drawing->source_count] = strdup(filepath);
+    loader->source = drawing->source_count++;
+}
+
+void loader_report(Loader* loader, DiagnosticKind kind) {
+    report_diagnostic(&loader->drawing->stats, kind, loader->source, loader->line_number, loader->byte_offset);
+}
+
+// Returns the index the record was stored at, for its attributes, or -1 if it was dropped
+int loader_add_point(Loader* loader, const char* label, int x, int y, double time) {
+    Drawing* drawing = loader->drawing;
+    const LoadOptions* options = loader->options;
+    bool duplicate;
+    Point point = {x, y, NULL, time};
+    HashEntry* entry = hash_table_insert(drawing->point_table, label, point, drawing->point_count, options->duplicate_policy, &duplicate);
+    if (!duplicate) {
+        drawing_append_point(drawing, entry->point);
+        if (options->verbose) printf("Parsed Point: (%d, %d, %s)\n", x, y, label);
+        return entry->index;
+    }
+    drawing->stats.duplicate_labels++;
+    if (options->duplicate_policy == DUPLICATE_LAST_WINS) {
+        drawing->points[entry->index] = entry->point;
+        drawing_clear_attributes(drawing, entry->index);
+        if (options->verbose) printf("Redefined Point: (%d, %d, %s)\n", x, y, label);
+        return entry->index;
+    }
+    if (options->duplicate_policy == DUPLICATE_ERROR) loader_report(loader, DIAG_DUPLICATE_LABEL);
+    return -1;
+}
+
+void loader_set_attribute(Loader* loader, int row, const char* key, const char* value) {
+    if (!drawing_set_attribute(loader->drawing, row, key, value)) loader_report(loader, DIAG_ATTRIBUTE_TYPE);
+}
+
+// Lines are buffered with their origin; references are checked in loader_finish
+void loader_add_line(Loader* loader, const char* label1, const char* label2) {
+    int pending = loader->drawing->line_count - loader->first_line;
+    if (pending == loader->origin_capacity) {
+        loader->origin_capacity = loader->origin_capacity ? loader->origin_capacity * 2 : 256;
+        loader->origins = realloc(loader->origins, loader->origin_capacity * sizeof(LineOrigin));
+    }
+    loader->origins[pending].line_number = loader->line_number;
+    loader->origins[pending].byte_offset = loader->byte_offset;
+    drawing_append_line(loader->drawing, label1, label2);
+}
+
+// Resolves the lines read from this file now that every point is known, and updates stats.
+// Returns false if the drawing has errors.
+bool loader_finish(Loader* loader) {
+    Drawing* drawing = loader->drawing;
+    const LoadOptions* options = loader->options;
+    LoadStats* stats = &drawing->stats;
+    if (options->dedup_lines && !drawing->seen_lines.keys) line_set_init(&drawing->seen_lines, 1024);
+    int kept = loader->first_line;
+    for (int i = loader->first_line; i < drawing->line_count; ++i) {
+        Line line = drawing->lines[i];
+        HashEntry* entry1 = hash_table_find_entry(drawing->point_table, line.label1);
+        HashEntry* entry2 = hash_table_find_entry(drawing->point_table, line.label2);
+        bool keep = false;
+        if (!entry1 || !entry2) {
+            LineOrigin* origin = &loader->origins[i - loader->first_line];
+            report_diagnostic(stats, DIAG_UNDEFINED_POINT, loader->source, origin->line_number, origin->byte_offset);
+        } else if (options->dedup_lines && !line_set_add(&drawing->seen_lines, line_key(entry1->index, entry2->index))) {
+            stats->duplicate_lines++;
+        } else {
+            keep = true;
+        }
+        if (keep) {
+            drawing->lines[kept++] = line;
+            if (options->verbose) printf("Parsed Line: %s to %s\n", line.label1, line.label2);
+        } else {
+            free(line.label1);
+            free(line.label2);
+        }
+    }
+    drawing->line_count = kept;
+    free(loader->origins);
+    loader->origins = NULL;
+    // Reference diagnostics were found after the pass; restore file order
+    sort_diagnostics(stats);
+
+    stats->points = drawing->point_count;
+    stats->lines = drawing->line_count;
+    if (options->verbose) {
+        printf("Finished parsing %s. Loaded %d points and %d lines (%d duplicate labels, %d duplicate lines removed).\n",
+               drawing->sources[loader->source], stats->points, stats->lines, stats->duplicate_labels, stats->duplicate_lines);
+    }
+    return stats->errors == 0;
+}
+
+// Opens filepath for a loader, reporting failure as a diagnostic
+bool loader_open(Loader* loader, ChunkReader* reader, Drawing* drawing, const LoadOptions* options, const char* filepath) {
+    loader_begin(loader, drawing, options, filepath);
+    if (!chunk_reader_open(reader, filepath)) {
+        loader_report(loader, DIAG_OPEN_FAILED);
+        sort_diagnostics(&drawing->stats);
+        return false;
+    }
+    return true;
+}
+
+// Reads plain input from an open stream, e.g. a drawing sent inline to the render server
+void chunk_reader_attach(ChunkReader* reader, FILE* file) {
+    memset(reader, 0, sizeof(ChunkReader));
+    reader->file = file;
+    reader->chunks[0] = malloc(READ_CHUNK_SIZE);
+    reader->line = malloc(MAX_RECORD_LENGTH + 1);
+}
+
+// Returns the next record of the file, skipping over-long ones with a diagnostic
+char* loader_next_record(Loader* loader, ChunkReader* reader) {
+    bool too_long;
+    char* record;
+    while ((record = chunk_reader_getline(reader, &loader->byte_offset, &too_long))) {
+        loader->line_number++;
+        if (!too_long) return record;
+        loader_report(loader, DIAG_RECORD_TOO_LONG);
+    }
+    if (reader->failed) loader_report(loader, DIAG_READ_FAILED);
+    return NULL;
+}
+
+// Reads every record from reader into the loader's drawing, then closes reader
+bool parse_drawing_records(Loader* loader, ChunkReader* reader) {
+    char* line_buffer;
+    while ((line_buffer = loader_next_record(loader, reader))) {
+        if (line_buffer[0] == '#' || line_buffer[0] == '\0') continue;
+
+        char* point_call_start = strstr(line_buffer, "point(");
+        char* line_call_start = point_call_start ? NULL : strstr(line_buffer, "line(");
+        if (point_call_start) {
+            char* param_start = point_call_start + strlen("point(");
+            char* param_end = strchr(param_start, ')');
+            char* first_comma = param_end ? memchr(param_start, ',', param_end - param_start) : NULL;
+            char* second_comma = first_comma ? memchr(first_comma + 1, ',', param_end - first_comma - 1) : NULL;
+            if (!second_comma) {
+                loader_report(loader, DIAG_POINT_SYNTAX);
+                continue;
+            }
+            *param_end = '\0';
+            *first_comma = '\0';
+            *second_comma = '\0';
+
+            int x, y;
+            if (sscanf(param_start, "%d", &x) != 1) {
+                loader_report(loader, DIAG_POINT_BAD_X);
+                continue;
+            }
+            if (sscanf(first_comma + 1, "%d", &y) != 1) {
+                loader_report(loader, DIAG_POINT_BAD_Y);
+                continue;
+            }
+            // Fields after the label are key=value attributes, and at most one bare time
+            double time = NAN;
+            char* keys[MAX_ATTRIBUTES];
+            char* values[MAX_ATTRIBUTES];
+            int attribute_count = 0;
+            DiagnosticKind problem = DIAG_KIND_COUNT;
+            char* field = strchr(second_comma + 1, ',');
+            if (field) *field++ = '\0';
+            while (field && problem == DIAG_KIND_COUNT) {
+                char* next = strchr(field, ',');
+                if (next) *next++ = '\0';
+                char* equals = strchr(field, '=');
+                if (equals) {
+                    *equals = '\0';
+                    keys[attribute_count] = trim_whitespace(field);
+                    values[attribute_count] = trim_whitespace(equals + 1);
+                    size_t value_length = strlen(values[attribute_count]);
+                    if (value_length >= 2 && values[attribute_count][0] == '"' && values[attribute_count][value_length - 1] == '"') {
+                        values[attribute_count][value_length - 1] = '\0'; // Quotes are optional around text values
+                        values[attribute_count]++;
+                    }
+                    if (attribute_count == MAX_ATTRIBUTES || *keys[attribute_count] == '\0') problem = DIAG_POINT_BAD_ATTRIBUTE;
+                    else attribute_count++;
+                } else {
+                    char* time_text = trim_whitespace(field);
+                    char* time_end;
+                    bool first_time = isnan(time);
+                    time = strtod(time_text, &time_end);
+                    if (!first_time || time_end == time_text || *time_end != '\0' || isnan(time)) problem = DIAG_POINT_BAD_TIME;
+                }
+                field = next;
+            }
+            if (problem != DIAG_KIND_COUNT) {
+                loader_report(loader, problem);
+                continue;
+            }
+            char* label_content = trim_whitespace(second_comma + 1);
+            if (*label_content == '\0') {
+                loader_report(loader, DIAG_POINT_MISSING_LABEL);
+                continue;
+            }
+            int row = loader_add_point(loader, label_content, x, y, time);
+            for (int i = 0; row >= 0 && i < attribute_count; ++i) {
+                loader_set_attribute(loader, row, keys[i], values[i]);
+            }
+        } else if (line_call_start) {
+            char* param_start = line_call_start + strlen("line(");
+            char* param_end = strchr(param_start, ')');
+            char* comma = param_end ? memchr(param_start, ',', param_end - param_start) : NULL;
+            if (!comma) {
+                loader_report(loader, DIAG_LINE_SYNTAX);
+                continue;
+            }
+            *param_end = '\0';
+            *comma = '\0';
+            char* label1 = trim_whitespace(param_start);
+            char* label2 = trim_whitespace(comma + 1);
+            if (*label1 == '\0' || *label2 == '\0') {
+                loader_report(loader, DIAG_LINE_MISSING_LABEL);
+                continue;
+            }
+            loader_add_line(loader, label1, label2);
+        }
+    }
+    chunk_reader_close(reader);
+    return loader_finish(loader);
+}
+
+// Appends to an initialized drawing in a single pass over the file, which may be
+// gzip-compressed. Lines may reference points defined later, so they are resolved once
+// the whole file has been read. Counts and diagnostics accumulate in drawing->stats.
+bool parse_drawing_file(const char* filepath, Drawing* drawing, const LoadOptions* options) {
+    Loader loader;
+    ChunkReader reader;
+    if (!loader_open(&loader, &reader, drawing, options, filepath)) return false;
+    return parse_drawing_records(&loader, &reader);
+}
+
+// Parses .vd text held in memory; name identifies it in diagnostics
+bool parse_drawing_text(const char* name, const char* text, size_t length, Drawing* drawing, const LoadOptions* options) {
+    Loader loader;
+    ChunkReader reader;
+    loader_begin(&loader, drawing, options, name);
+    FILE* file = length > 0 ? fmemopen((void*)text, length, "rb") : NULL;
+    if (!file) return loader_finish(&loader); // Empty input
+    chunk_reader_attach(&reader, file);
+    return parse_drawing_records(&loader, &reader);
+}
+
+// --- CSV Import Functions ---
+// Splits a CSV record in place. Fields may be double-quoted, with "" for a literal quote.
+// Returns the number of fields, or -1 if there are more than max_fields.
+int split_csv_fields(char* record, char** fields, int max_fields) {
+    int count = 0;
+    char* read = record;
+    for (;;) {
+        if (count == max_fields) return -1;
+        char* write = read;
+        fields[count++] = write;
+        if (*read == '"') {
+            read++;
+            while (*read) {
+                if (*read == '"' && read[1] == '"') {
+                    *write++ = '"';
+                    read += 2;
+                } else if (*read == '"') {
+                    read++;
+                    break;
+                } else {
+                    *write++ = *read++;
+                }
+            }
+            char* comma = strchr(read, ',');
+            read = comma ? comma : read + strlen(read);
+        } else {
+            char* comma = strchr(read, ',');
+            size_t length = comma ? (size_t)(comma - read) : strlen(read);
+            write = read + length;
+            read = write;
+        }
+        bool more = *read == ',';
+        *write = '\0';
+        if (!more) return count;
+        read++;
+    }
+}
+
+// Parses a coordinate, accepting decimals (rounded to the nearest pixel)
+bool parse_csv_coordinate(const char* field, int* value) {
+    char* end;
+    double parsed = strtod(field, &end);
+    while (isspace((unsigned char)*end)) end++;
+    if (end == field || *end != '\0' || !isfinite(parsed) || parsed < INT32_MIN || parsed > INT32_MAX) return false;
+    *value = (int)lround(parsed);
+    return true;
+}
+
+// Imports "label,x,y" rows. A first record whose coordinates are not numbers is a header; it may
+// name further columns, which become point attributes (a column named "time" is the point time).
+bool import_points_csv(const char* filepath, Drawing* drawing, const LoadOptions* options) {
+    Loader loader;
+    ChunkReader reader;
+    if (!loader_open(&loader, &reader, drawing, options, filepath)) return false;
+
+    char* record;
+    char* fields[3 + MAX_ATTRIBUTES];
+    char* header[3 + MAX_ATTRIBUTES] = {NULL};
+    int field_count = 3;
+    int time_field = -1;
+    bool first_record = true; // Comments and blank lines may precede the header
+    while ((record = loader_next_record(&loader, &reader))) {
+        if (record[0] == '#' || record[0] == '\0') continue;
+        bool first = first_record;
+        first_record = false;
+        int count = split_csv_fields(record, fields, 3 + MAX_ATTRIBUTES);
+        if (count < 3 || (count != field_count && !first)) {
+            loader_report(&loader, DIAG_CSV_FIELD_COUNT);
+            continue;
+        }
+        int x, y;
+        bool x_ok = parse_csv_coordinate(fields[1], &x);
+        bool y_ok = parse_csv_coordinate(fields[2], &y);
+        if (!x_ok && !y_ok && first) { // Header
+            field_count = count;
+            for (int i = 3; i < count; ++i) {
+                char* name = trim_whitespace(fields[i]);
+                if (*name == '\0') {
+                    loader_report(&loader, DIAG_CSV_EMPTY_HEADER);
+                    continue;
+                }
+                header[i] = strdup(name);
+                if (strcmp(header[i], "time") == 0) time_field = i;
+            }
+            continue;
+        }
+        if (count != field_count) {
+            loader_report(&loader, DIAG_CSV_FIELD_COUNT);
+            continue;
+        }
+        if (!x_ok || !y_ok) {
+            loader_report(&loader, x_ok ? DIAG_POINT_BAD_Y : DIAG_POINT_BAD_X);
+            continue;
+        }
+        char* label = trim_whitespace(fields[0]);
+        if (*label == '\0') {
+            loader_report(&loader, DIAG_POINT_MISSING_LABEL);
+            continue;
+        }
+        double time = NAN;
+        if (time_field >= 0) {
+            char* time_text = trim_whitespace(fields[time_field]);
+            char* time_end;
+            time = strtod(time_text, &time_end);
+            if (*time_text != '\0' && (time_end == time_text || *time_end != '\0')) {
+                loader_report(&loader, DIAG_POINT_BAD_TIME);
+                continue;
+            }
+        }
+        int row = loader_add_point(&loader, label, x, y, time);
+        for (int i = 3; row >= 0 && i < field_count; ++i) {
+            char* value = trim_whitespace(fields[i]);
+            if (header[i] && i != time_field && *value != '\0') loader_set_attribute(&loader, row, header[i], value);
+        }
+    }
+    for (int i = 3; i < field_count; ++i) free(header[i]);
+    chunk_reader_close(&reader);
+    return loader_finish(&loader);
+}
+
+// Imports "label1,label2" rows referencing points already loaded. A first row naming
+// undefined points is treated as a header.
+bool import_edges_csv(const char* filepath, Drawing* drawing, const LoadOptions* options) {
+    Loader loader;
+    ChunkReader reader;
+    if (!loader_open(&loader, &reader, drawing, options, filepath)) return false;
+
+    char* record;
+    char* fields[2];
+    while ((record = loader_next_record(&loader, &reader))) {
+        if (record[0] == '#' || record[0] == '\0') continue;
+        if (split_csv_fields(record, fields, 2) != 2) {
+            loader_report(&loader, DIAG_CSV_FIELD_COUNT);
+            continue;
+        }
+        char* label1 = trim_whitespace(fields[0]);
+        char* label2 = trim_whitespace(fields[1]);
+        if (loader.line_number == 1 && !hash_table_get(drawing->point_table, label1) && !hash_table_get(drawing->point_table, label2)) {
+            continue; // Header
+        }
+        if (*label1 == '\0' || *label2 == '\0') {
+            loader_report(&loader, DIAG_LINE_MISSING_LABEL);
+            continue;
+        }
+        loader_add_line(&loader, label1, label2);
+    }
+    chunk_reader_close(&reader);
+    return loader_finish(&loader);
+}
+
+// --- GeoJSON Import Functions ---
+int json_peek(JsonScanner* scanner) {
+    ChunkReader* reader = scanner->reader;
+    if (reader->position >= reader->length && !chunk_reader_advance(reader)) return -1;
+    return (unsigned char)reader->data[reader->position];
+}
+
+int json_next_char(JsonScanner* scanner) {
+    int c = json_peek(scanner);
+    if (c >= 0) {
+        scanner->reader->position++;
+        if (c == '\n') scanner->line_number++;
+    }
+    return c;
+}
+
+int64_t json_offset(JsonScanner* scanner) {
+    return scanner->reader->chunk_offset + scanner->reader->position;
+}
+
+void json_append_text(JsonScanner* scanner, unsigned int c) {
+    if (scanner->text_length < MAX_RECORD_LENGTH) scanner->text[scanner->text_length++] = (char)c;
+}
+
+int json_hex_digit(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool json_scan_string(JsonScanner* scanner) {
+    scanner->text_length = 0;
+    for (;;) {
+        int c = json_next_char(scanner);
+        if (c < 0 || c == '\n') return false;
+        if (c == '"') break;
+        if (c != '\\') {
+            json_append_text(scanner, c);
+            continue;
+        }
+        c = json_next_char(scanner);
+        switch (c) {
+            case 'b': json_append_text(scanner, '\b'); break;
+            case 'f': json_append_text(scanner, '\f'); break;
+            case 'n': json_append_text(scanner, '\n'); break;
+            case 'r': json_append_text(scanner, '\r'); break;
+            case 't': json_append_text(scanner, '\t'); break;
+            case 'u': {
+                unsigned int code = 0;
+                for (int i = 0; i < 4; ++i) {
+                    int digit = json_hex_digit(json_next_char(scanner));
+                    if (digit < 0) return false;
+                    code = code * 16 + digit;
+                }
+                if (code >= 0xD800 && code <= 0xDFFF) code = '?'; // Surrogate halves are not recombined
+                if (code < 0x80) {
+                    json_append_text(scanner, code);
+                } else if (code < 0x800) {
+                    json_append_text(scanner, 0xC0 | (code >> 6));
+                    json_append_text(scanner, 0x80 | (code & 0x3F));
+                } else {
+                    json_append_text(scanner, 0xE0 | (code >> 12));
+                    json_append_text(scanner, 0x80 | ((code >> 6) & 0x3F));
+                    json_append_text(scanner, 0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            case '"': case '\\': case '/': json_append_text(scanner, c); break;
+            default: return false;
+        }
+    }
+    scanner->text[scanner->text_length] = '\0';
+    return true;
+}
+
+JsonToken json_next(JsonScanner* scanner) {
+    int c;
+    while ((c = json_peek(scanner)) == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        json_next_char(scanner);
+    }
+    if (c < 0) return JSON_END;
+    json_next_char(scanner);
+    switch (c) {
+        case '{': return JSON_BEGIN_OBJECT;
+        case '}': return JSON_END_OBJECT;
+        case '[': return JSON_BEGIN_ARRAY;
+        case ']': return JSON_END_ARRAY;
+        case ',': return JSON_COMMA;
+        case ':': return JSON_COLON;
+        case '"': return json_scan_string(scanner) ? JSON_STRING : JSON_ERROR;
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        char digits[64];
+        int length = 0;
+        digits[length++] = (char)c;
+        while ((c = json_peek(scanner)) >= 0 && (isdigit(c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')) {
+            if (length == (int)sizeof(digits) - 1) return JSON_ERROR; // Too long to parse without truncating
+            digits[length++] = (char)c;
+            json_next_char(scanner);
+        }
+        digits[length] = '\0';
+        char* end;
+        scanner->number = strtod(digits, &end);
+        return *end == '\0' ? JSON_NUMBER : JSON_ERROR;
+    }
+    if (c == 't' || c == 'f' || c == 'n') {
+        const char* literal = c == 't' ? "rue" : c == 'f' ? "alse" : "ull";
+        for (; *literal; ++literal) {
+            if (json_next_char(scanner) != *literal) return JSON_ERROR;
+        }
+        return JSON_LITERAL;
+    }
+    return JSON_ERROR;
+}
+
+bool json_skip_value(JsonScanner* scanner, JsonToken token, int depth) {
+    if (token == JSON_STRING || token == JSON_NUMBER || token == JSON_LITERAL) return true;
+    if ((token != JSON_BEGIN_OBJECT && token != JSON_BEGIN_ARRAY) || depth >= MAX_JSON_DEPTH) return false;
+    bool object = token == JSON_BEGIN_OBJECT;
+    JsonToken close = object ? JSON_END_OBJECT : JSON_END_ARRAY;
+    token = json_next(scanner);
+    if (token == close) return true;
+    for (;;) {
+        if (object) {
+            if (token != JSON_STRING || json_next(scanner) != JSON_COLON) return false;
+            token = json_next(scanner);
+        }
+        if (!json_skip_value(scanner, token, depth + 1)) return false;
+        token = json_next(scanner);
+        if (token == close) return true;
+        if (token != JSON_COMMA) return false;
+        token = json_next(scanner);
+    }
+}
+
+void geo_feature_free(GeoFeature* feature) {
+    free(feature->label);
+    free(feature->coordinates);
+    free(feature->part_ends);
+    memset(feature, 0, sizeof(GeoFeature));
+}
+
+void geo_add_vertex(GeoFeature* feature, double x, double y) {
+    if (feature->vertex_count == feature->vertex_capacity) {
+        feature->vertex_capacity = feature->vertex_capacity ? feature->vertex_capacity * 2 : 16;
+        feature->coordinates = realloc(feature->coordinates, feature->vertex_capacity * 2 * sizeof(double));
+    }
+    feature->coordinates[2 * feature->vertex_count] = x;
+    feature->coordinates[2 * feature->vertex_count + 1] = y;
+    feature->vertex_count++;
+}
+
+void geo_end_part(GeoFeature* feature) {
+    if (feature->part_count == feature->part_capacity) {
+        feature->part_capacity = feature->part_capacity ? feature->part_capacity * 2 : 4;
+        feature->part_ends = realloc(feature->part_ends, feature->part_capacity * sizeof(int));
+    }
+    feature->part_ends[feature->part_count++] = feature->vertex_count;
+}
+
+// Parses a coordinates array whose '[' has been read. Returns its nesting level
+// (0 for a position, 1 for a list of positions, ...) or -1 if it is malformed.
+int geojson_parse_coordinates(JsonScanner* scanner, GeoFeature* feature, int depth) {
+    double values[2] = {0, 0};
+    int value_count = 0;
+    int child_level = -2; // -2: empty so far, -1: numbers, >= 0: nested arrays
+    JsonToken token = json_next(scanner);
+    if (token == JSON_END_ARRAY) return 1;
+    for (;;) {
+        if (token == JSON_NUMBER && child_level < 0) {
+            if (value_count < 2) values[value_count] = scanner->number;
+            value_count++;
+            child_level = -1;
+        } else if (token == JSON_BEGIN_ARRAY && child_level != -1 && depth < MAX_JSON_DEPTH) {
+            int level = geojson_parse_coordinates(scanner, feature, depth + 1);
+            if (level < 0 || (child_level >= 0 && level != child_level)) return -1;
+            child_level = level;
+        } else {
+            return -1;
+        }
+        token = json_next(scanner);
+        if (token == JSON_END_ARRAY) break;
+        if (token != JSON_COMMA) return -1;
+        token = json_next(scanner);
+    }
+    if (child_level == -1) {
+        if (value_count < 2) return -1;
+        geo_add_vertex(feature, values[0], values[1]);
+        return 0;
+    }
+    if (child_level == 0) geo_end_part(feature);
+    return child_level + 1;
+}
+
+bool geojson_parse_properties(JsonScanner* scanner, GeoFeature* feature, int depth) {
+    JsonToken token = json_next(scanner);
+    if (token == JSON_END_OBJECT) return true;
+    for (;;) {
+        if (token != JSON_STRING || json_next(scanner) != JSON_COLON) return false;
+        int priority = strcmp(scanner->text, "label") == 0 ? 3 : strcmp(scanner->text, "name") == 0 ? 2 : strcmp(scanner->text, "id") == 0 ? 1 : 0;
+        token = json_next(scanner);
+        if (priority > feature->label_priority && (token == JSON_STRING || token == JSON_NUMBER)) {
+            char number[32];
+            if (token == JSON_NUMBER) snprintf(number, sizeof(number), "%.15g", scanner->number);
+            free(feature->label);
+            feature->label = strdup(token == JSON_STRING ? scanner->text : number);
+            feature->label_priority = priority;
+        } else if (!json_skip_value(scanner, token, depth + 1)) {
+            return false;
+        }
+        token = json_next(scanner);
+        if (token == JSON_END_OBJECT) return true;
+        if (token != JSON_COMMA) return false;
+        token = json_next(scanner);
+    }
+}
+
+bool geojson_parse_object(JsonScanner* scanner, Loader* loader, GeoFeature* feature, int depth);
+
+// Adds a finished feature: Point and MultiPoint become points; every line or ring of the
+// other geometries becomes a polyline of points labelled "<label>#<feature>.<part>.<vertex>".
+// The feature index keeps features that share a name from overwriting each other's vertices.
+void geojson_emit_feature(Loader* loader, GeoFeature* feature, int feature_index) {
+    if (feature->vertex_count == 0 && feature->type[0] == '\0') return; // Not a feature
+    loader->line_number = feature->line_number;
+    loader->byte_offset = feature->byte_offset;
+    char fallback[32];
+    snprintf(fallback, sizeof(fallback), "feature%d", feature_index);
+    const char* base = feature->label ? feature->label : fallback;
+    char prefix[MAX_RECORD_LENGTH + 32]; // Base of generated labels
+    if (feature->label) snprintf(prefix, sizeof(prefix), "%s#%d", feature->label, feature_index);
+    else snprintf(prefix, sizeof(prefix), "%s", fallback);
+    char label[MAX_RECORD_LENGTH + 64];
+    const double* c = feature->coordinates;
+
+    bool point = strcmp(feature->type, "Point") == 0;
+    bool multi_point = strcmp(feature->type, "MultiPoint") == 0;
+    bool lines = strcmp(feature->type, "LineString") == 0 || strcmp(feature->type, "MultiLineString") == 0 ||
+                 strcmp(feature->type, "Polygon") == 0 || strcmp(feature->type, "MultiPolygon") == 0;
+    if (point && feature->vertex_count == 1) {
+        loader_add_point(loader, base, (int)lround(c[0]), (int)lround(c[1]), NAN);
+    } else if (multi_point) {
+        for (int i = 0; i < feature->vertex_count; ++i) {
+            snprintf(label, sizeof(label), "%s.%d", prefix, i);
+            loader_add_point(loader, label, (int)lround(c[2 * i]), (int)lround(c[2 * i + 1]), NAN);
+        }
+    } else if (lines && feature->part_count > 0) {
+        char previous[sizeof(label)];
+        char first[sizeof(label)];
+        for (int part = 0, start = 0; part < feature->part_count; start = feature->part_ends[part++]) {
+            int end = feature->part_ends[part];
+            bool closed = end - start > 2 && c[2 * start] == c[2 * (end - 1)] && c[2 * start + 1] == c[2 * (end - 1) + 1];
+            if (closed) end--; // A ring repeats its first vertex; link back to it instead
+            for (int i = start; i < end; ++i) {
+                snprintf(label, sizeof(label), "%s.%d.%d", prefix, part, i - start);
+                loader_add_point(loader, label, (int)lround(c[2 * i]), (int)lround(c[2 * i + 1]), NAN);
+                if (i > start) loader_add_line(loader, previous, label);
+                else strcpy(first, label);
+                strcpy(previous, label);
+            }
+            if (closed) loader_add_line(loader, previous, first);
+        }
+    } else {
+        loader_report(loader, DIAG_JSON_GEOMETRY);
+    }
+}
+
+// Parses a "features" array, emitting each feature as soon as its object closes so only
+// one feature is held in memory at a time
+bool geojson_parse_features(JsonScanner* scanner, Loader* loader, int depth) {
+    JsonToken token = json_next(scanner);
+    if (token == JSON_END_ARRAY) return true;
+    for (;;) {
+        if (token == JSON_BEGIN_OBJECT) {
+            GeoFeature feature = {0};
+            feature.line_number = scanner->line_number;
+            feature.byte_offset = json_offset(scanner) - 1;
+            bool ok = geojson_parse_object(scanner, loader, &feature, depth + 1);
+            if (ok) geojson_emit_feature(loader, &feature, scanner->feature_count++);
+            geo_feature_free(&feature);
+            if (!ok) return false;
+        } else if (!json_skip_value(scanner, token, depth + 1)) {
+            return false;
+        }
+        token = json_next(scanner);
+        if (token == JSON_END_ARRAY) return true;
+        if (token != JSON_COMMA) return false;
+        token = json_next(scanner);
+    }
+}
+
+// Parses an object whose '{' has been read. Feature, geometry and collection members
+// all land in the same GeoFeature; nested "features" arrays are emitted as they stream by.
+bool geojson_parse_object(JsonScanner* scanner, Loader* loader, GeoFeature* feature, int depth) {
+    if (depth >= MAX_JSON_DEPTH) return false;
+    JsonToken token = json_next(scanner);
+    if (token == JSON_END_OBJECT) return true;
+    for (;;) {
+        if (token != JSON_STRING || json_next(scanner) != JSON_COLON) return false;
+        // Every member handled below fits; a longer key stays empty so its value is skipped
+        char key[16] = "";
+        if (scanner->text_length < (int)sizeof(key)) memcpy(key, scanner->text, scanner->text_length + 1);
+        token = json_next(scanner);
+        bool ok;
+        if (strcmp(key, "type") == 0 && token == JSON_STRING) {
+            // Only geometry types are kept, so "Feature" never overwrites "Point"
+            ok = true;
+            if (strcmp(scanner->text, "Feature") != 0 && strcmp(scanner->text, "FeatureCollection") != 0) {
+                snprintf(feature->type, sizeof(feature->type), "%s", scanner->text);
+            }
+        } else if (strcmp(key, "geometry") == 0 && token == JSON_BEGIN_OBJECT) {
+            ok = geojson_parse_object(scanner, loader, feature, depth + 1);
+        } else if (strcmp(key, "coordinates") == 0 && token == JSON_BEGIN_ARRAY) {
+            ok = geojson_parse_coordinates(scanner, feature, depth + 1) >= 0;
+        } else if (strcmp(key, "properties") == 0 && token == JSON_BEGIN_OBJECT) {
+            ok = geojson_parse_properties(scanner, feature, depth + 1);
+        } else if (strcmp(key, "features") == 0 && token == JSON_BEGIN_ARRAY) {
+            ok = geojson_parse_features(scanner, loader, depth + 1);
+        } else {
+            ok = json_skip_value(scanner, token, depth + 1);
+        }
+        if (!ok) return false;
+        token = json_next(scanner);
+        if (token == JSON_END_OBJECT) return true;
+        if (token != JSON_COMMA) return false;
+        token = json_next(scanner);
+    }
+}
+
+// Imports a GeoJSON FeatureCollection, Feature or geometry with a streaming scanner; memory
+// is bounded by the largest single feature, not the file
+bool import_geojson(const char* filepath, Drawing* drawing, const LoadOptions* options) {
+    Loader loader;
+    ChunkReader reader;
+    if (!loader_open(&loader, &reader, drawing, options, filepath)) return false;
+
+    JsonScanner scanner = {0};
+    scanner.reader = &reader;
+    scanner.text = malloc(MAX_RECORD_LENGTH + 1);
+    scanner.line_number = 1;
+    GeoFeature feature = {0};
+    feature.line_number = 1;
+    bool ok = json_next(&scanner) == JSON_BEGIN_OBJECT && geojson_parse_object(&scanner, &loader, &feature, 0) &&
+              json_next(&scanner) == JSON_END;
+    if (ok) {
+        geojson_emit_feature(&loader, &feature, 0); // A bare Feature or geometry
+    } else {
+        loader.line_number = scanner.line_number;
+        loader.byte_offset = json_offset(&scanner);
+        loader_report(&loader, reader.failed ? DIAG_READ_FAILED : DIAG_JSON_SYNTAX);
+    }
+    geo_feature_free(&feature);
+    free(scanner.text);
+    chunk_reader_close(&reader);
+    return loader_finish(&loader);
+}
+
+// Loads every input named in options into drawing: the .vd file, CSV points, GeoJSON, then CSV edges
+bool load_drawing(Drawing* drawing, const Options* options) {
+    bool ok = true;
+    if (options->drawing_file_path) ok &= parse_drawing_file(options->drawing_file_path, drawing, &options->load);
+    if (options->points_csv_path) ok &= import_points_csv(options->points_csv_path, drawing, &options->load);
+    if (options->geojson_path) ok &= import_geojson(options->geojson_path, drawing, &options->load);
+    if (options->edges_csv_path) ok &= import_edges_csv(options->edges_csv_path, drawing, &options->load);
+    return ok;
+}
+
+// Name used for the drawing in summaries
+const char* primary_input(const Options* options) {
+    if (options->drawing_file_path) return options->drawing_file_path;
+    if (options->points_csv_path) return options->points_csv_path;
+    if (options->geojson_path) return options->geojson_path;
+    return options->edges_csv_path ? options->edges_csv_path : "drawing";
+}
+
+// --- Statistics Functions ---
+typedef struct {
+    const Drawing* drawing;
+    DrawingStats* partials;  // One per worker
+    int64_t* label_lengths;  // Per-worker sums
+    int* endpoints;          // Two point indices per line, -1 if unresolved
+} StatsContext;
+
+void stats_points_task(void* data, int worker, int begin, int end) {
+    StatsContext* context = data;
+    const Point* points = context->drawing->points;
+    DrawingStats* partial = &context->partials[worker];
+    int min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+    int min_len = INT32_MAX, max_len = 0;
+    int64_t len_sum = 0;
+    for (int i = begin; i < end; ++i) {
+        int x = points[i].x, y = points[i].y;
+        min_x = x < min_x ? x : min_x;
+        max_x = x > max_x ? x : max_x;
+        min_y = y < min_y ? y : min_y;
+        max_y = y > max_y ? y : max_y;
+        int len = (int)strlen(points[i].label);
+        min_len = len < min_len ? len : min_len;
+        max_len = len > max_len ? len : max_len;
+        len_sum += len;
+    }
+    partial->min_x = min_x;
+    partial->min_y = min_y;
+    partial->max_x = max_x;
+    partial->max_y = max_y;
+    partial->min_label_length = min_len;
+    partial->max_label_length = max_len;
+    context->label_lengths[worker] = len_sum;
+}
+
+void stats_lines_task(void* data, int worker, int begin, int end) {
+    StatsContext* context = data;
+    const Drawing* drawing = context->drawing;
+    for (int i = begin; i < end; ++i) {
+        HashEntry* entry1 = hash_table_find_entry(drawing->point_table, drawing->lines[i].label1);
+        HashEntry* entry2 = hash_table_find_entry(drawing->point_table, drawing->lines[i].label2);
+        context->endpoints[2 * i] = entry1 ? entry1->index : -1;
+        context->endpoints[2 * i + 1] = entry2 ? entry2->index : -1;
+    }
+}
+
+// One parallel pass over the points (bounds, label lengths) and one over the lines
+// (endpoint resolution); per-worker partials are reduced on the calling thread.
+void compute_drawing_stats(const Drawing* drawing, DrawingStats* stats) {
+    memset(stats, 0, sizeof(DrawingStats));
+    StatsContext context;
+    context.drawing = drawing;
+    context.partials = calloc(MAX_WORKERS, sizeof(DrawingStats));
+    context.label_lengths = calloc(MAX_WORKERS, sizeof(int64_t));
+    context.endpoints = malloc((size_t)drawing->line_count * 2 * sizeof(int) + 1);
+
+    if (drawing->point_count > 0) {
+        int workers = parallel_worker_count(drawing->point_count, 65536);
+        parallel_for(drawing->point_count, 65536, stats_points_task, &context);
+        *stats = context.partials[0];
+        int64_t label_length_sum = 0;
+        for (int w = 0; w < workers; ++w) {
+            DrawingStats* partial = &context.partials[w];
+            if (partial->min_x < stats->min_x) stats->min_x = partial->min_x;
+            if (partial->min_y < stats->min_y) stats->min_y = partial->min_y;
+            if (partial->max_x > stats->max_x) stats->max_x = partial->max_x;
+            if (partial->max_y > stats->max_y) stats->max_y = partial->max_y;
+            if (partial->min_label_length < stats->min_label_length) stats->min_label_length = partial->min_label_length;
+            if (partial->max_label_length > stats->max_label_length) stats->max_label_length = partial->max_label_length;
+            label_length_sum += context.label_lengths[w];
+        }
+        stats->mean_label_length = (double)label_length_sum / drawing->point_count;
+    }
+
+    parallel_for(drawing->line_count, 65536, stats_lines_task, &context);
+    int* degrees = calloc(drawing->point_count + 1, sizeof(int));
+    int64_t degree_sum = 0;
+    for (int i = 0; i < 2 * drawing->line_count; ++i) {
+        if (context.endpoints[i] >= 0) {
+            degrees[context.endpoints[i]]++;
+            degree_sum++;
+        }
+    }
+    stats->min_degree = drawing->point_count > 0 ? INT32_MAX : 0;
+    for (int i = 0; i < drawing->point_count; ++i) {
+        int degree = degrees[i];
+        if (degree < stats->min_degree) stats->min_degree = degree;
+        if (degree > stats->max_degree) stats->max_degree = degree;
+        stats->degree_histogram[degree < DEGREE_HISTOGRAM_BUCKETS ? degree : DEGREE_HISTOGRAM_BUCKETS - 1]++;
+    }
+    stats->mean_degree = drawing->point_count > 0 ? (double)degree_sum / drawing->point_count : 0.0;
+
+    free(degrees);
+    free(context.endpoints);
+    free(context.label_lengths);
+    free(context.partials);
+}
+
+void print_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const unsigned char* c = (const unsigned char*)text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void print_drawing_stats_json(FILE* out, const char* filepath, const Drawing* drawing, const DrawingStats* stats) {
+    fprintf(out, "{\n  \"file\": ");
+    print_json_string(out, filepath);
+    fprintf(out, ",\n  \"points\": %d,\n  \"lines\": %d,\n", drawing->point_count, drawing->line_count);
+    fprintf(out, "  \"duplicate_labels\": %d,\n  \"duplicate_lines\": %d,\n", drawing->stats.duplicate_labels, drawing->stats.duplicate_lines);
+    fprintf(out, "  \"errors\": %d,\n  \"warnings\": %d,\n", drawing->stats.errors, drawing->stats.warnings);
+    if (drawing->point_count > 0) {
+        fprintf(out, "  \"bounding_box\": {\"min_x\": %d, \"min_y\": %d, \"max_x\": %d, \"max_y\": %d},\n",
+                stats->min_x, stats->min_y, stats->max_x, stats->max_y);
+    } else {
+        fprintf(out, "  \"bounding_box\": null,\n");
+    }
+    fprintf(out, "  \"degree\": {\"min\": %d, \"max\": %d, \"mean\": %.4f, \"histogram\": [",
+            stats->min_degree, stats->max_degree, stats->mean_degree);
+    int buckets = stats->max_degree + 1 < DEGREE_HISTOGRAM_BUCKETS ? stats->max_degree + 1 : DEGREE_HISTOGRAM_BUCKETS;
+    for (int i = 0; i < buckets; ++i) {
+        fprintf(out, "%s%d", i ? ", " : "", stats->degree_histogram[i]);
+    }
+    fprintf(out, "], \"histogram_open_ended\": %s},\n", stats->max_degree >= DEGREE_HISTOGRAM_BUCKETS - 1 ? "true" : "false");
+    fprintf(out, "  \"label_length\": {\"min\": %d, \"max\": %d, \"mean\": %.4f},\n",
+            stats->min_label_length, stats->max_label_length, stats->mean_label_length);
+    fprintf(out, "  \"diagnostics\": [");
+    for (int i = 0; i < drawing->stats.diagnostic_count; ++i) {
+        const Diagnostic* diagnostic = &drawing->stats.diagnostics[i];
+        fprintf(out, "%s\n    {\"file\": ", i ? "," : "");
+        print_json_string(out, drawing->sources[diagnostic->source]);
+        fprintf(out, ", \"kind\": \"%s\", \"severity\": \"%s\", \"line\": %d, \"offset\": %lld}",
+                diagnostic_kind_name(diagnostic->kind), diagnostic_is_error(diagnostic->kind) ? "error" : "warning",
+                diagnostic->line_number, (long long)diagnostic->byte_offset);
+    }
+    fprintf(out, "%s]\n}\n", drawing->stats.diagnostic_count ? "\n  " : "");
+}
+
+// --- Buffered Writer Functions ---
+// Opens path for writing; "-" writes to stdout
+bool writer_open(BufferedWriter* writer, const char* path) {
+    memset(writer, 0, sizeof(BufferedWriter));
+    writer->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
+    writer->buffer = malloc(WRITER_BUFFER_SIZE);
+    return true;
+}
+
+void writer_flush(BufferedWriter* writer) {
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->file) != (size_t)writer->length) {
+        writer->failed = true;
+    }
+    writer->length = 0;
+}
+
+void writer_write(BufferedWriter* writer, const void* data, size_t size) {
+    if (writer->length + size > WRITER_BUFFER_SIZE) writer_flush(writer);
+    if (size >= WRITER_BUFFER_SIZE) {
+        if (fwrite(data, 1, size, writer->file) != size) writer->failed = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->length, data, size);
+    writer->length += size;
+}
+
+void writer_printf(BufferedWriter* writer, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int available = WRITER_BUFFER_SIZE - writer->length;
+    int needed = vsnprintf(writer->buffer + writer->length, available, format, args);
+    va_end(args);
+    if (needed < available) {
+        writer->length += needed;
+        return;
+    }
+    // Did not fit: flush and format again, into a temporary if it exceeds the whole buffer
+    writer_flush(writer);
+    char* text = needed < WRITER_BUFFER_SIZE ? writer->buffer : malloc(needed + 1);
+    va_start(args, format);
+    vsnprintf(text, needed + 1, format, args);
+    va_end(args);
+    if (text == writer->buffer) {
+        writer->length = needed;
+    } else {
+        writer_write(writer, text, needed);
+        free(text);
+    }
+}
+
+// Flushes and closes the writer. Returns false if any write failed.
+bool writer_close(BufferedWriter* writer) {
+    writer_flush(writer);
+    if (writer->file == stdout) {
+        if (fflush(stdout) != 0) writer->failed = true;
+    } else if (fclose(writer->file) != 0) {
+        writer->failed = true;
+    }
+    free(writer->buffer);
+    writer->buffer = NULL;
+    return !writer->failed;
+}
+
+// --- SVG Export Functions ---
+void svg_write_escaped(BufferedWriter* writer, const char* text) {
+    const char* run = text;
+    for (const char* c = text;; ++c) {
+        const char* entity = *c == '&' ? "&amp;" : *c == '<' ? "&lt;" : *c == '>' ? "&gt;" : *c == '"' ? "&quot;" : NULL;
+        if (!entity && *c != '\0') continue;
+        writer_write(writer, run, c - run);
+        if (!entity) return;
+        writer_write(writer, entity, strlen(entity));
+        run = c + 1;
+    }
+}
+
+const char* image_mime_type(const char* path) {
+    const char* extension = strrchr(path, '.');
+    if (extension && (SDL_strcasecmp(extension, ".jpg") == 0 || SDL_strcasecmp(extension, ".jpeg") == 0)) return "image/jpeg";
+    if (extension && SDL_strcasecmp(extension, ".webp") == 0) return "image/webp";
+    if (extension && SDL_strcasecmp(extension, ".bmp") == 0) return "image/bmp";
+    return "image/png";
+}
+
+// Streams the file at path as base64 without holding it in memory
+bool svg_write_base64_file(BufferedWriter* writer, const char* path) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open image %s for embedding\n", path);
+        return false;
+    }
+    unsigned char input[3 * 4096];
+    char output[4 * 4096];
+    size_t read;
+    while ((read = fread(input, 1, sizeof(input), file)) > 0) {
+        int length = 0;
+        for (size_t i = 0; i < read; i += 3) {
+            unsigned int group = input[i] << 16;
+            if (i + 1 < read) group |= input[i + 1] << 8;
+            if (i + 2 < read) group |= input[i + 2];
+            output[length++] = alphabet[(group >> 18) & 63];
+            output[length++] = alphabet[(group >> 12) & 63];
+            output[length++] = i + 1 < read ? alphabet[(group >> 6) & 63] : '=';
+            output[length++] = i + 2 < read ? alphabet[group & 63] : '=';
+        }
+        writer_write(writer, output, length);
+        if (read < sizeof(input)) break; // Only the last block may need padding
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+// Writes the drawing as one group per style: lines as polylines (consecutive lines that share
+// an endpoint are chained into one element), then point markers, then labels.
+bool export_svg(const char* path, const Drawing* drawing, const char* image_path, SvgImageMode image_mode, int width, int height) {
+    BufferedWriter writer;
+    if (!writer_open(&writer, path)) return false;
+    bool ok = true;
+    writer_printf(&writer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    writer_printf(&writer, "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+                           "width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n", width, height, width, height);
+    if (image_path && image_mode != SVG_IMAGE_NONE) {
+        writer_printf(&writer, "<image x=\"0\" y=\"0\" width=\"%d\" height=\"%d\" xlink:href=\"", width, height);
+        if (image_mode == SVG_IMAGE_EMBED) {
+            writer_printf(&writer, "data:%s;base64,", image_mime_type(image_path));
+            ok = svg_write_base64_file(&writer, image_path);
+        } else {
+            svg_write_escaped(&writer, image_path);
+        }
+        writer_printf(&writer, "\"/>\n");
+    }
+
+    writer_printf(&writer, "<g fill=\"none\" stroke=\"rgb(%d,%d,%d)\" stroke-width=\"1\" stroke-linejoin=\"round\">\n",
+                  COLOR_RED.r, COLOR_RED.g, COLOR_RED.b);
+    const char* tail = NULL; // Label the open polyline ends at
+    for (int i = 0; i < drawing->line_count; ++i) {
+        Line line = drawing->lines[i];
+        Point* p1 = hash_table_get(drawing->point_table, line.label1);
+        Point* p2 = hash_table_get(drawing->point_table, line.label2);
+        if (!p1 || !p2 || !line_is_visible(drawing, line)) continue;
+        if (!tail || strcmp(tail, line.label1) != 0) {
+            if (tail) writer_printf(&writer, "\"/>\n");
+            writer_printf(&writer, "<polyline points=\"%d,%d", p1->x, p1->y);
+        }
+        writer_printf(&writer, " %d,%d", p2->x, p2->y);
+        tail = line.label2;
+    }
+    if (tail) writer_printf(&writer, "\"/>\n");
+    writer_printf(&writer, "</g>\n");
+
+    writer_printf(&writer, "<g fill=\"rgb(%d,%d,%d)\">\n", COLOR_BLACK.r, COLOR_BLACK.g, COLOR_BLACK.b);
+    for (int i = 0; i < drawing->point_count; ++i) {
+        if (drawing->point_flags[i]) continue;
+        writer_printf(&writer, "<circle cx=\"%d\" cy=\"%d\" r=\"%d\"/>\n", drawing->points[i].x, drawing->points[i].y, DRAW_POINT_RADIUS);
+    }
+    writer_printf(&writer, "</g>\n");
+
+    // Labels sit where draw_point_with_label puts them; a white halo stands in for the text background
+    writer_printf(&writer, "<g font-family=\"DejaVu Sans\" font-size=\"%d\" dominant-baseline=\"hanging\" fill=\"rgb(%d,%d,%d)\" "
+                           "stroke=\"rgb(%d,%d,%d)\" stroke-width=\"3\" paint-order=\"stroke\">\n",
+                  FONT_SIZE, COLOR_BLACK.r, COLOR_BLACK.g, COLOR_BLACK.b, COLOR_WHITE_BG.r, COLOR_WHITE_BG.g, COLOR_WHITE_BG.b);
+    for (int i = 0; i < drawing->point_count; ++i) {
+        if (drawing->point_flags[i]) continue;
+        Point point = drawing->points[i];
+        writer_printf(&writer, "<text x=\"%d\" y=\"%d\">", point.x + DRAW_POINT_RADIUS + 5, point.y - DRAW_POINT_RADIUS);
+        svg_write_escaped(&writer, point.label);
+        writer_printf(&writer, "</text>\n");
+    }
+    writer_printf(&writer, "</g>\n</svg>\n");
+    if (!writer_close(&writer)) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        ok = false;
+    }
+    return ok;
+}
+
+// --- Time Index Functions ---
+int compare_time_entries(const void* a, const void* b) {
+    const TimeEntry* entry_a = a;
+    const TimeEntry* entry_b = b;
+    if (entry_a->time != entry_b->time) return entry_a->time < entry_b->time ? -1 : 1;
+    return entry_a->point - entry_b->point;
+}
+
+// Sorts the timed points by time. Needed once after loading and again after points are deleted.
+void drawing_build_time_index(Drawing* drawing) {
+    free(drawing->time_index);
+    drawing->time_index = malloc((drawing->point_count + 1) * sizeof(TimeEntry));
+    drawing->time_count = 0;
+    for (int i = 0; i < drawing->point_count; ++i) {
+        if (!isnan(drawing->points[i].time)) {
+            drawing->time_index[drawing->time_count].time = drawing->points[i].time;
+            drawing->time_index[drawing->time_count].point = i;
+            drawing->time_count++;
+        }
+    }
+    qsort(drawing->time_index, drawing->time_count, sizeof(TimeEntry), compare_time_entries);
+    drawing->time_index_valid = true;
+}
+
+// Returns the first entry with a time >= time, or > time when after is set
+int time_index_search(const Drawing* drawing, double time, bool after) {
+    int low = 0, high = drawing->time_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        double entry_time = drawing->time_index[mid].time;
+        if (entry_time < time || (after && entry_time == time)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void time_index_set_hidden(Drawing* drawing, int begin, int end, bool hidden) {
+    if (begin < end) drawing->revision++;
+    for (int i = begin; i < end; ++i) {
+        Uint8* flags = &drawing->point_flags[drawing->time_index[i].point];
+        *flags = hidden ? (*flags | POINT_HIDDEN_BY_TIME) : (*flags & ~POINT_HIDDEN_BY_TIME);
+    }
+}
+
+// Moves the visible range to [start, start + width]: two binary searches, then only the
+// entries that enter or leave the range have their flags changed
+void time_scrubber_update(Drawing* drawing, TimeScrubber* scrubber) {
+    if (!drawing->time_index_valid) {
+        // Points were deleted and indices shifted; rebuild and re-derive every timed flag
+        drawing_build_time_index(drawing);
+        scrubber->first = scrubber->last = 0;
+        time_index_set_hidden(drawing, 0, drawing->time_count, true);
+    }
+    int first = time_index_search(drawing, scrubber->start, false);
+    int last = time_index_search(drawing, scrubber->start + scrubber->width, true);
+    int old_first = scrubber->first, old_last = scrubber->last;
+    time_index_set_hidden(drawing, old_first, old_last < first ? old_last : first, true);
+    time_index_set_hidden(drawing, last > old_first ? last : old_first, old_last, true);
+    time_index_set_hidden(drawing, first, last < old_first ? last : old_first, false);
+    time_index_set_hidden(drawing, old_last > first ? old_last : first, last, false);
+    scrubber->first = first;
+    scrubber->last = last;
+}
+
+void time_scrubber_toggle(Drawing* drawing, TimeScrubber* scrubber) {
+    if (!drawing->time_index_valid) drawing_build_time_index(drawing);
+    if (scrubber->enabled) {
+        time_index_set_hidden(drawing, 0, drawing->time_count, false);
+        scrubber->enabled = false;
+        return;
+    }
+    if (drawing->time_count == 0) {
+        printf("No points have a time value.\n");
+        return;
+    }
+    if (scrubber->width <= 0) {
+        double min_time = drawing->time_index[0].time;
+        double max_time = drawing->time_index[drawing->time_count - 1].time;
+        scrubber->start = min_time;
+        scrubber->width = max_time > min_time ? (max_time - min_time) / 10 : 1;
+    }
+    time_index_set_hidden(drawing, 0, drawing->time_count, true);
+    scrubber->first = scrubber->last = 0;
+    scrubber->enabled = true;
+    time_scrubber_update(drawing, scrubber);
+}
+
+// Draws the scrubber track along the bottom edge with the visible range highlighted
+void draw_time_scrubber(SDL_Renderer* renderer, TTF_Font* font, const Drawing* drawing, const TimeScrubber* scrubber, int width, int height) {
+    if (!scrubber->enabled || drawing->time_count == 0) return;
+    double min_time = drawing->time_index[0].time;
+    double span = drawing->time_index[drawing->time_count - 1].time - min_time;
+    if (span <= 0) span = 1;
+    SDL_Rect track = {10, height - 16, width - 20, 6};
+    set_draw_color(renderer, COLOR_BLACK);
+    SDL_RenderFillRect(renderer, &track);
+    double begin = (scrubber->start - min_time) / span, end = (scrubber->start + scrubber->width - min_time) / span;
+    if (begin < 0) begin = 0;
+    if (end > 1) end = 1;
+    if (end > begin) {
+        SDL_Rect range = {track.x + (int)(begin * track.w), track.y, (int)((end - begin) * track.w) + 1, track.h};
+        set_draw_color(renderer, COLOR_RED);
+        SDL_RenderFillRect(renderer, &range);
+    }
+    char text[128];
+    snprintf(text, sizeof(text), "time %.6g .. %.6g (%d points)", scrubber->start, scrubber->start + scrubber->width, scrubber->last - scrubber->first);
+    draw_text(renderer, font, text, track.x, track.y - FONT_SIZE - 8, COLOR_BLACK);
+}
+
+// --- Filter Functions ---
+typedef struct {
+    const Drawing* drawing;
+    const char* text;
+    const char* position;
+    bool failed;
+    char* token; // Current key or text value; sized to text, shared by every nesting level
+} FilterParser;
+
+void free_filter(FilterNode* node) {
+    if (!node) return;
+    free_filter(node->left);
+    free_filter(node->right);
+    free(node);
+}
+
+int filter_depth(const FilterNode* node) {
+    if (!node || node->kind == FILTER_COMPARE) return 1;
+    int left = filter_depth(node->left), right = filter_depth(node->right);
+    return 1 + (left > right ? left : right);
+}
+
+void filter_skip_space(FilterParser* parser) {
+    while (isspace((unsigned char)*parser->position)) parser->position++;
+}
+
+bool filter_accept(FilterParser* parser, const char* token) {
+    filter_skip_space(parser);
+    if (strncmp(parser->position, token, strlen(token)) != 0) return false;
+    parser->position += strlen(token);
+    return true;
+}
+
+FilterNode* filter_error(FilterParser* parser, const char* message) {
+    if (!parser->failed) {
+        fprintf(stderr, "Invalid filter: %s at column %d of \"%s\"\n", message, (int)(parser->position - parser->text) + 1, parser->text);
+    }
+    parser->failed = true;
+    return NULL;
+}
+
+FilterNode* filter_parse_or(FilterParser* parser, int depth);
+
+// comparison := key op value | '(' expression ')'
+FilterNode* filter_parse_primary(FilterParser* parser, int depth) {
+    if (depth >= MAX_FILTER_DEPTH) return filter_error(parser, "expression nested too deeply");
+    if (filter_accept(parser, "(")) {
+        FilterNode* node = filter_parse_or(parser, depth + 1);
+        if (node && !filter_accept(parser, ")")) {
+            free_filter(node);
+            return filter_error(parser, "expected ')'");
+        }
+        return node;
+    }
+    filter_skip_space(parser);
+    char* key = parser->token;
+    int length = 0;
+    while (isalnum((unsigned char)*parser->position) || *parser->position == '_' || *parser->position == '.') {
+        key[length++] = *parser->position++;
+    }
+    key[length] = '\0';
+    if (length == 0) return filter_error(parser, "expected an attribute name");
+    int column = drawing_find_column(parser->drawing, key);
+    if (column < 0) return filter_error(parser, "unknown attribute");
+
+    static const char* operators[] = {"==", "!=", "<=", ">=", "<", ">"};
+    static const FilterOp operator_ops[] = {FILTER_EQ, FILTER_NE, FILTER_LE, FILTER_GE, FILTER_LT, FILTER_GT};
+    int op = 0;
+    while (op < 6 && !filter_accept(parser, operators[op])) op++;
+    if (op == 6) return filter_error(parser, "expected a comparison operator");
+
+    FilterNode* node = calloc(1, sizeof(FilterNode));
+    node->kind = FILTER_COMPARE;
+    node->column = column;
+    node->op = operator_ops[op];
+    const AttributeColumn* attribute = &parser->drawing->columns[column];
+    filter_skip_space(parser);
+    if (attribute->type == ATTRIBUTE_NUMBER) {
+        char* end;
+        node->number = strtod(parser->position, &end);
+        if (end == parser->position) {
+            free(node);
+            return filter_error(parser, "expected a number");
+        }
+        parser->position = end;
+        return node;
+    }
+    if (node->op != FILTER_EQ && node->op != FILTER_NE) {
+        free(node);
+        return filter_error(parser, "text attributes only support == and !=");
+    }
+    // A text value is quoted, or a bare word up to the next space or operator
+    char* value = parser->token; // The key is no longer needed
+    length = 0;
+    if (*parser->position == '"') {
+        const char* close = strchr(parser->position + 1, '"');
+        if (!close) {
+            free(node);
+            return filter_error(parser, "unterminated string");
+        }
+        length = close - parser->position - 1;
+        memcpy(value, parser->position + 1, length);
+        parser->position = close + 1;
+    } else {
+        while (*parser->position && !isspace((unsigned char)*parser->position) && !strchr("()&|", *parser->position)) {
+            value[length++] = *parser->position++;
+        }
+    }
+    value[length] = '\0';
+    HashEntry* entry = hash_table_find_entry(attribute->dictionary, value);
+    node->code = entry ? entry->index : -2;
+    return node;
+}
+
+FilterNode* filter_parse_binary(FilterParser* parser, int depth, FilterNodeKind kind) {
+    const char* token = kind == FILTER_OR ? "||" : "&&";
+    FilterNode* left = kind == FILTER_OR ? filter_parse_binary(parser, depth, FILTER_AND) : filter_parse_primary(parser, depth);
+    while (left && filter_accept(parser, token)) {
+        FilterNode* right = kind == FILTER_OR ? filter_parse_binary(parser, depth, FILTER_AND) : filter_parse_primary(parser, depth);
+        if (!right) {
+            free_filter(left);
+            return NULL;
+        }
+        FilterNode* node = calloc(1, sizeof(FilterNode));
+        node->kind = kind;
+        node->left = left;
+        node->right = right;
+        left = node;
+    }
+    return left;
+}
+
+FilterNode* filter_parse_or(FilterParser* parser, int depth) {
+    return filter_parse_binary(parser, depth, FILTER_OR);
+}
+
+// Compiles "key op value" comparisons joined by && and || (with parentheses) against the
+// drawing's attribute columns. Returns NULL after printing an error.
+FilterNode* compile_filter(const Drawing* drawing, const char* text) {
+    FilterParser parser = {drawing, text, text, false, malloc(strlen(text) + 1)};
+    FilterNode* node = filter_parse_or(&parser, 0);
+    filter_skip_space(&parser);
+    if (node && *parser.position != '\0') {
+        free_filter(node);
+        node = filter_error(&parser, "unexpected text");
+    }
+    free(parser.token);
+    return node;
+}
+
+// Evaluates node for rows [begin, begin + count) into out (1 = match). Each comparison is a
+// branch-free loop over one column; scratch holds FILTER_BATCH bytes per level below this one.
+void filter_evaluate_batch(const FilterNode* node, const Drawing* drawing, int begin, int count, Uint8* out, Uint8* scratch) {
+    if (node->kind != FILTER_COMPARE) {
+        filter_evaluate_batch(node->left, drawing, begin, count, out, scratch);
+        filter_evaluate_batch(node->right, drawing, begin, count, scratch, scratch + FILTER_BATCH);
+        if (node->kind == FILTER_AND) {
+            for (int i = 0; i < count; ++i) out[i] &= scratch[i];
+        } else {
+            for (int i = 0; i < count; ++i) out[i] |= scratch[i];
+        }
+        return;
+    }
+    const AttributeColumn* column = &drawing->columns[node->column];
+    if (column->type == ATTRIBUTE_STRING) {
+        const int* codes = column->codes + begin;
+        int code = node->code;
+        if (node->op == FILTER_EQ) {
+            for (int i = 0; i < count; ++i) out[i] = codes[i] == code;
+        } else {
+            for (int i = 0; i < count; ++i) out[i] = codes[i] >= 0 && codes[i] != code;
+        }
+        return;
+    }
+    // Missing values are NAN, which fails every comparison but !=, so that one checks explicitly
+    const double* values = column->numbers + begin;
+    double operand = node->number;
+    switch (node->op) {
+        case FILTER_EQ: for (int i = 0; i < count; ++i) out[i] = values[i] == operand; break;
+        case FILTER_NE: for (int i = 0; i < count; ++i) out[i] = values[i] == values[i] && values[i] != operand; break;
+        case FILTER_LT: for (int i = 0; i < count; ++i) out[i] = values[i] < operand; break;
+        case FILTER_LE: for (int i = 0; i < count; ++i) out[i] = values[i] <= operand; break;
+        case FILTER_GT: for (int i = 0; i < count; ++i) out[i] = values[i] > operand; break;
+        case FILTER_GE: for (int i = 0; i < count; ++i) out[i] = values[i] >= operand; break;
+    }
+}
+
+typedef struct {
+    const FilterNode* filter;
+    Drawing* drawing;
+    int depth;
+} FilterContext;
+
+void filter_task(void* data, int worker, int begin, int end) {
+    FilterContext* context = data;
+    Drawing* drawing = context->drawing;
+    Uint8* masks = malloc((size_t)(context->depth + 1) * FILTER_BATCH);
+    for (int batch = begin; batch < end; ++batch) {
+        int first = batch * FILTER_BATCH;
+        int count = drawing->point_count - first < FILTER_BATCH ? drawing->point_count - first : FILTER_BATCH;
+        filter_evaluate_batch(context->filter, drawing, first, count, masks, masks + FILTER_BATCH);
+        Uint8* flags = drawing->point_flags + first;
+        for (int i = 0; i < count; ++i) {
+            flags[i] = masks[i] ? (flags[i] & ~POINT_HIDDEN_BY_FILTER) : (flags[i] | POINT_HIDDEN_BY_FILTER);
+        }
+    }
+    free(masks);
+}
+
+// Sets POINT_HIDDEN_BY_FILTER on every point the filter rejects, or clears it everywhere
+// when filter is NULL. Batches are split across worker threads.
+void apply_filter(Drawing* drawing, const FilterNode* filter) {
+    drawing->revision++;
+    if (!filter) {
+        for (int i = 0; i < drawing->point_count; ++i) drawing->point_flags[i] &= ~POINT_HIDDEN_BY_FILTER;
+        return;
+    }
+    FilterContext context = {filter, drawing, filter_depth(filter)};
+    int batch_count = (drawing->point_count + FILTER_BATCH - 1) / FILTER_BATCH;
+    parallel_for(batch_count, 16, filter_task, &context);
+}
+
+// Compiles and applies --filter after loading. Returns false if the expression is invalid.
+bool apply_filter_option(Drawing* drawing, const Options* options, FilterNode** compiled) {
+    *compiled = NULL;
+    if (!options->filter) return true;
+    *compiled = compile_filter(drawing, options->filter);
+    if (!*compiled) return false;
+    apply_filter(drawing, *compiled);
+    return true;
+}
+
+// --- Heatmap Functions ---
+// Transparent for empty cells, then blue through cyan, yellow and red with rising opacity
+void heatmap_build_lut(Heatmap* heatmap) {
+    static const float stops[][4] = {
+        {0, 0, 255, 96}, {0, 255, 255, 160}, {255, 255, 0, 208}, {255, 0, 0, 240}, {255, 255, 255, 255}};
+    heatmap->lut[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+        float t = (i - 1) / 254.0f * 4;
+        int stop = t >= 4 ? 3 : (int)t;
+        float f = t - stop;
+        Uint32 channels[4];
+        for (int c = 0; c < 4; ++c) channels[c] = (Uint32)(stops[stop][c] + f * (stops[stop + 1][c] - stops[stop][c]));
+        heatmap->lut[i] = (channels[3] << 24) | (channels[0] << 16) | (channels[1] << 8) | channels[2];
+    }
+}
+
+void heatmap_init(Heatmap* heatmap, int width, int height, float sigma) {
+    memset(heatmap, 0, sizeof(Heatmap));
+    heatmap->width = width;
+    heatmap->height = height;
+    heatmap->sigma = sigma;
+    heatmap_build_lut(heatmap);
+}
+
+void heatmap_free(Heatmap* heatmap) {
+    free(heatmap->counts);
+    free(heatmap->density);
+    free(heatmap->scratch);
+    if (heatmap->texture) SDL_DestroyTexture(heatmap->texture);
+    memset(heatmap, 0, sizeof(Heatmap));
+}
+
+typedef struct {
+    const Drawing* drawing;
+    Heatmap* heatmap;
+    Uint32* partials[MAX_WORKERS]; // Worker 0 accumulates straight into heatmap->counts
+    int worker_count;
+    float weights[2 * MAX_BLUR_RADIUS + 1];
+    int radius;
+} HeatmapContext;
+
+void heatmap_bin_task(void* data, int worker, int begin, int end) {
+    HeatmapContext* context = data;
+    const Drawing* drawing = context->drawing;
+    int width = context->heatmap->width, height = context->heatmap->height;
+    Uint32* counts = worker == 0 ? context->heatmap->counts : context->partials[worker];
+    for (int i = begin; i < end; ++i) {
+        const Point* point = &drawing->points[i];
+        if (drawing->point_flags[i] || (unsigned)point->x >= (unsigned)width || (unsigned)point->y >= (unsigned)height) continue;
+        counts[point->y * width + point->x]++;
+    }
+}
+
+// Sums the per-worker histograms row by row into counts and converts to float density
+void heatmap_merge_task(void* data, int worker, int begin, int end) {
+    HeatmapContext* context = data;
+    Heatmap* heatmap = context->heatmap;
+    size_t first = (size_t)begin * heatmap->width, last = (size_t)end * heatmap->width;
+    for (int w = 1; w < context->worker_count; ++w) {
+        const Uint32* partial = context->partials[w];
+        for (size_t i = first; i < last; ++i) heatmap->counts[i] += partial[i];
+    }
+    for (size_t i = first; i < last; ++i) heatmap->density[i] = (float)heatmap->counts[i];
+}
+
+// Horizontal pass, density -> scratch. Each row is copied into a clamp-padded buffer so every
+// tap is a contiguous multiply-add over the row that the compiler can vectorize.
+void heatmap_blur_rows_task(void* data, int worker, int begin, int end) {
+    HeatmapContext* context = data;
+    Heatmap* heatmap = context->heatmap;
+    int width = heatmap->width, radius = context->radius;
+    float* padded = malloc((width + 2 * radius) * sizeof(float));
+    for (int y = begin; y < end; ++y) {
+        const float* in = heatmap->density + (size_t)y * width;
+        float* out = heatmap->scratch + (size_t)y * width;
+        for (int x = 0; x < radius; ++x) {
+            padded[x] = in[0];
+            padded[radius + width + x] = in[width - 1];
+        }
+        memcpy(padded + radius, in, width * sizeof(float));
+        memset(out, 0, width * sizeof(float));
+        for (int k = 0; k <= 2 * radius; ++k) {
+            float weight = context->weights[k];
+            const float* source = padded + k;
+            for (int x = 0; x < width; ++x) out[x] += weight * source[x];
+        }
+    }
+    free(padded);
+}
+
+// Vertical pass, scratch -> density; rows are contiguous so each tap is again a row-wide multiply-add
+void heatmap_blur_columns_task(void* data, int worker, int begin, int end) {
+    HeatmapContext* context = data;
+    Heatmap* heatmap = context->heatmap;
+    int width = heatmap->width, height = heatmap->height, radius = context->radius;
+    for (int y = begin; y < end; ++y) {
+        float* out = heatmap->density + (size_t)y * width;
+        memset(out, 0, width * sizeof(float));
+        for (int k = -radius; k <= radius; ++k) {
+            int source_y = y + k < 0 ? 0 : y + k >= height ? height - 1 : y + k;
+            const float* source = heatmap->scratch + (size_t)source_y * width;
+            float weight = context->weights[k + radius];
+            for (int x = 0; x < width; ++x) out[x] += weight * source[x];
+        }
+    }
+}
+
+typedef struct {
+    const Heatmap* heatmap;
+    Uint8* pixels;
+    int pitch;
+    float scale;
+} HeatmapColorContext;
+
+// Maps density through the LUT on a log scale, so sparse areas stay visible next to hot spots
+void heatmap_color_task(void* data, int worker, int begin, int end) {
+    HeatmapColorContext* context = data;
+    const Heatmap* heatmap = context->heatmap;
+    for (int y = begin; y < end; ++y) {
+        const float* density = heatmap->density + (size_t)y * heatmap->width;
+        Uint32* row = (Uint32*)(context->pixels + (size_t)y * context->pitch);
+        for (int x = 0; x < heatmap->width; ++x) {
+            int index = density[x] > 0 ? 1 + (int)(254 * logf(1 + density[x]) * context->scale) : 0;
+            row[x] = heatmap->lut[index > 255 ? 255 : index];
+        }
+    }
+}
+
+// Rebuilds the histogram and uploads the texture when the drawing's visible points or the
+// blur radius changed since the last build
+void heatmap_update(SDL_Renderer* renderer, Heatmap* heatmap, const Drawing* drawing) {
+    if (heatmap->built && heatmap->revision == drawing->revision && heatmap->built_sigma == heatmap->sigma) return;
+    size_t cells = (size_t)heatmap->width * heatmap->height;
+    if (!heatmap->counts) {
+        heatmap->counts = malloc(cells * sizeof(Uint32));
+        heatmap->density = malloc(cells * sizeof(float));
+        heatmap->scratch = malloc(cells * sizeof(float));
+    }
+    if (!heatmap->texture) {
+        heatmap->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, heatmap->width, heatmap->height);
+        if (!heatmap->texture) {
+            fprintf(stderr, "Failed to create heatmap texture! SDL Error: %s\n", SDL_GetError());
+            return;
+        }
+        SDL_SetTextureBlendMode(heatmap->texture, SDL_BLENDMODE_BLEND);
+    }
+
+    HeatmapContext context = {0};
+    context.drawing = drawing;
+    context.heatmap = heatmap;
+    // Workers past the first need their own full-size histogram, so large images get fewer
+    // of them, and a histogram that can't be allocated drops its worker
+    int workers = parallel_worker_count(drawing->point_count, HEATMAP_POINTS_PER_WORKER);
+    size_t budget_workers = 1 + HEATMAP_PARTIAL_BUDGET / (cells * sizeof(Uint32));
+    if ((size_t)workers > budget_workers) workers = (int)budget_workers;
+    for (int w = 1; w < workers; ++w) {
+        context.partials[w] = calloc(cells, sizeof(Uint32));
+        if (!context.partials[w]) {
+            workers = w;
+            break;
+        }
+    }
+    context.worker_count = workers;
+    int chunk = (drawing->point_count + workers - 1) / workers;
+    if (chunk < HEATMAP_POINTS_PER_WORKER) chunk = HEATMAP_POINTS_PER_WORKER;
+    memset(heatmap->counts, 0, cells * sizeof(Uint32));
+    parallel_for(drawing->point_count, chunk, heatmap_bin_task, &context);
+    parallel_for(heatmap->height, 16, heatmap_merge_task, &context);
+    for (int w = 1; w < context.worker_count; ++w) free(context.partials[w]);
+
+    context.radius = (int)ceilf(3 * heatmap->sigma);
+    if (context.radius > MAX_BLUR_RADIUS) context.radius = MAX_BLUR_RADIUS;
+    if (context.radius > 0) {
+        float total = 0;
+        for (int k = -context.radius; k <= context.radius; ++k) {
+            context.weights[k + context.radius] = expf(-(k * k) / (2 * heatmap->sigma * heatmap->sigma));
+            total += context.weights[k + context.radius];
+        }
+        for (int k = 0; k <= 2 * context.radius; ++k) context.weights[k] /= total;
+        parallel_for(heatmap->height, 16, heatmap_blur_rows_task, &context);
+        parallel_for(heatmap->height, 16, heatmap_blur_columns_task, &context);
+    }
+
+    float max_density = 0;
+    for (size_t i = 0; i < cells; ++i) {
+        if (heatmap->density[i] > max_density) max_density = heatmap->density[i];
+    }
+    HeatmapColorContext color = {heatmap, NULL, 0, max_density > 0 ? 1 / logf(1 + max_density) : 0};
+    void* pixels;
+    if (SDL_LockTexture(heatmap->texture, NULL, &pixels, &color.pitch) != 0) {
+        fprintf(stderr, "Failed to lock heatmap texture! SDL Error: %s\n", SDL_GetError());
+        return;
+    }
+    color.pixels = pixels;
+    parallel_for(heatmap->height, 16, heatmap_color_task, &color);
+    SDL_UnlockTexture(heatmap->texture);
+    heatmap->revision = drawing->revision;
+    heatmap->built_sigma = heatmap->sigma;
+    heatmap->built = true;
+}
+
+// --- Point Cloud Functions ---
+void point_cloud_init(PointCloud* cloud, int width, int height) {
+    memset(cloud, 0, sizeof(PointCloud));
+    cloud->width = width;
+    cloud->height = height;
+    cloud->point_size = 1;
+}
+
+void point_cloud_free(PointCloud* cloud) {
+    free(cloud->xs);
+    free(cloud->ys);
+    if (cloud->texture) SDL_DestroyTexture(cloud->texture);
+    memset(cloud, 0, sizeof(PointCloud));
+}
+
+typedef struct {
+    const PointCloud* cloud;
+    Uint32* pixels;
+    int stride; // Pixels per texture row
+    Uint32 color;
+} PointCloudContext;
+
+void point_cloud_clear_task(void* data, int worker, int begin, int end) {
+    PointCloudContext* context = data;
+    for (int y = begin; y < end; ++y) {
+        memset(context->pixels + (size_t)y * context->stride, 0, context->cloud->width * sizeof(Uint32));
+    }
+}
+
+// Computes a batch of pixel offsets in a branch-free loop, then stores the color at each. Every
+// writer stores the same color, so points from different workers landing on one pixel agree.
+void point_cloud_scatter_task(void* data, int worker, int begin, int end) {
+    PointCloudContext* context = data;
+    const PointCloud* cloud = context->cloud;
+    int size = cloud->point_size;
+    unsigned int limit_x = cloud->width - size + 1, limit_y = cloud->height - size + 1;
+    Uint32 offsets[POINT_CLOUD_BATCH];
+    for (int first = begin; first < end; first += POINT_CLOUD_BATCH) {
+        int count = end - first < POINT_CLOUD_BATCH ? end - first : POINT_CLOUD_BATCH;
+        const Sint32* xs = cloud->xs + first;
+        const Sint32* ys = cloud->ys + first;
+        for (int i = 0; i < count; ++i) {
+            bool inside = (unsigned int)xs[i] < limit_x && (unsigned int)ys[i] < limit_y;
+            offsets[i] = inside ? (Uint32)(ys[i] * context->stride + xs[i]) : UINT32_MAX;
+        }
+        Uint32* pixels = context->pixels;
+        Uint32 color = context->color;
+        if (size == 1) {
+            for (int i = 0; i < count; ++i) {
+                if (offsets[i] != UINT32_MAX) pixels[offsets[i]] = color;
+            }
+        } else {
+            int stride = context->stride;
+            for (int i = 0; i < count; ++i) {
+                if (offsets[i] == UINT32_MAX) continue;
+                Uint32* pixel = pixels + offsets[i];
+                pixel[0] = pixel[1] = pixel[stride] = pixel[stride + 1] = color;
+            }
+        }
+    }
+}
+
+// Re-copies the visible coordinates when the drawing changed, and re-renders the texture
+// when the coordinates or the point size changed; otherwise the last texture is reused
+void point_cloud_update(SDL_Renderer* renderer, PointCloud* cloud, const Drawing* drawing) {
+    if (cloud->built && cloud->revision == drawing->revision && cloud->built_size == cloud->point_size) return;
+    if (!cloud->texture) {
+        cloud->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, cloud->width, cloud->height);
+        if (!cloud->texture) {
+            fprintf(stderr, "Failed to create point cloud texture! SDL Error: %s\n", SDL_GetError());
+            return;
+        }
+        SDL_SetTextureBlendMode(cloud->texture, SDL_BLENDMODE_BLEND);
+    }
+    if (!cloud->built || cloud->revision != drawing->revision) {
+        if (cloud->capacity < drawing->point_count) {
+            cloud->capacity = drawing->point_count;
+            cloud->xs = realloc(cloud->xs, cloud->capacity * sizeof(Sint32));
+            cloud->ys = realloc(cloud->ys, cloud->capacity * sizeof(Sint32));
+        }
+        cloud->count = 0;
+        for (int i = 0; i < drawing->point_count; ++i) {
+            if (drawing->point_flags[i]) continue;
+            cloud->xs[cloud->count] = drawing->points[i].x;
+            cloud->ys[cloud->count] = drawing->points[i].y;
+            cloud->count++;
+        }
+    }
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(cloud->texture, NULL, &pixels, &pitch) != 0) {
+        fprintf(stderr, "Failed to lock point cloud texture! SDL Error: %s\n", SDL_GetError());
+        return;
+    }
+    PointCloudContext context = {cloud, pixels, pitch / (int)sizeof(Uint32),
+                                 ((Uint32)COLOR_BLACK.a << 24) | (COLOR_BLACK.r << 16) | (COLOR_BLACK.g << 8) | COLOR_BLACK.b};
+    parallel_for(cloud->height, 16, point_cloud_clear_task, &context);
+    parallel_for(cloud->count, HEATMAP_POINTS_PER_WORKER, point_cloud_scatter_task, &context);
+    SDL_UnlockTexture(cloud->texture);
+    cloud->revision = drawing->revision;
+    cloud->built_size = cloud->point_size;
+    cloud->built = true;
+}
+
+// --- Line Density Functions ---
+// Transparent, then the line color with rising opacity, brightening to yellow and white where dense
+void line_density_init(LineDensity* density, int width, int height) {
+    memset(density, 0, sizeof(LineDensity));
+    density->width = width;
+    density->height = height;
+    density->lut[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+        float t = i / 255.0f;
+        Uint32 alpha = (Uint32)(96 + 159 * (t < 0.5f ? t * 2 : 1));
+        Uint32 green = t < 0.5f ? 0 : (Uint32)(255 * (t - 0.5f) * 2);
+        Uint32 blue = t < 0.85f ? 0 : (Uint32)(255 * (t - 0.85f) / 0.15f);
+        density->lut[i] = (alpha << 24) | ((Uint32)COLOR_RED.r << 16) | (green << 8) | blue;
+    }
+}
+
+void line_density_free(LineDensity* density) {
+    free(density->counts);
+    free(density->endpoints);
+    if (density->texture) SDL_DestroyTexture(density->texture);
+    memset(density, 0, sizeof(LineDensity));
+}
+
+// Returns the step range [*first, *last] of a DDA from start with increment delta per step
+// whose rounded coordinate falls in [low, high)
+void dda_clip(double start, double delta, int steps, int low, int high, int* first, int* last) {
+    if (delta == 0) {
+        int value = (int)lround(start);
+        *first = value >= low && value < high ? 0 : 1;
+        *last = value >= low && value < high ? steps : 0;
+        return;
+    }
+    double a = (low - 0.5 - start) / delta, b = (high - 0.5 - start) / delta;
+    double lo = floor(a < b ? a : b) - 1, hi = ceil(a < b ? b : a) + 1;
+    *first = lo < 0 ? 0 : lo > steps ? steps + 1 : (int)lo;
+    *last = hi > steps ? steps : hi < 0 ? -1 : (int)hi;
+}
+
+// Rasterizes every line into the rows [begin, end) this worker owns. Lines are clipped to the
+// band first, so each worker only walks the pixels it will write.
+void line_density_band_task(void* data, int worker, int begin, int end) {
+    LineDensity* density = data;
+    int width = density->width;
+    memset(density->counts + (size_t)begin * width, 0, (size_t)(end - begin) * width * sizeof(Uint32));
+    for (int i = 0; i < density->line_count; ++i) {
+        const Sint32* line = density->endpoints + 4 * i;
+        int y_min = line[1] < line[3] ? line[1] : line[3], y_max = line[1] < line[3] ? line[3] : line[1];
+        if (y_max < begin || y_min >= end) continue;
+        int dx = line[2] - line[0], dy = line[3] - line[1];
+        int steps = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+        double x_step = steps ? (double)dx / steps : 0, y_step = steps ? (double)dy / steps : 0;
+        int first_y, last_y, first_x, last_x;
+        dda_clip(line[1], y_step, steps, begin, end, &first_y, &last_y);
+        dda_clip(line[0], x_step, steps, 0, width, &first_x, &last_x);
+        int first = first_y > first_x ? first_y : first_x, last = last_y < last_x ? last_y : last_x;
+        // Walk in 16.16 fixed point; adding one half up front makes the shift round to nearest
+        int64_t x_increment = llround(x_step * 65536), y_increment = llround(y_step * 65536);
+        int64_t x_fixed = ((int64_t)line[0] << 16) + 0x8000 + first * x_increment;
+        int64_t y_fixed = ((int64_t)line[1] << 16) + 0x8000 + first * y_increment;
+        for (int step = first; step <= last; ++step, x_fixed += x_increment, y_fixed += y_increment) {
+            int x = (int)(x_fixed >> 16), y = (int)(y_fixed >> 16);
+            if (y >= begin && y < end && x >= 0 && x < width) density->counts[(size_t)y * width + x]++;
+        }
+    }
+}
+
+typedef struct {
+    const LineDensity* density;
+    Uint8* pixels;
+    int pitch;
+    float scale;
+} LineDensityColorContext;
+
+void line_density_color_task(void* data, int worker, int begin, int end) {
+    LineDensityColorContext* context = data;
+    const LineDensity* density = context->density;
+    for (int y = begin; y < end; ++y) {
+        const Uint32* counts = density->counts + (size_t)y * density->width;
+        Uint32* row = (Uint32*)(context->pixels + (size_t)y * context->pitch);
+        for (int x = 0; x < density->width; ++x) {
+            int index = counts[x] ? 1 + (int)(254 * logf(1.0f + counts[x]) * context->scale) : 0;
+            row[x] = density->lut[index > 255 ? 255 : index];
+        }
+    }
+}
+
+// Re-accumulates and uploads when the drawing changed since the last build
+void line_density_update(SDL_Renderer* renderer, LineDensity* density, const Drawing* drawing) {
+    if (density->built && density->revision == drawing->revision) return;
+    if (!density->texture) {
+        density->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, density->width, density->height);
+        if (!density->texture) {
+            fprintf(stderr, "Failed to create line density texture! SDL Error: %s\n", SDL_GetError());
+            return;
+        }
+        SDL_SetTextureBlendMode(density->texture, SDL_BLENDMODE_BLEND);
+        density->counts = malloc((size_t)density->width * density->height * sizeof(Uint32));
+    }
+    if (density->line_capacity < drawing->line_count) {
+        density->line_capacity = drawing->line_count;
+        density->endpoints = realloc(density->endpoints, density->line_capacity * 4 * sizeof(Sint32));
+    }
+    density->line_count = 0;
+    for (int i = 0; i < drawing->line_count; ++i) {
+        HashEntry* entry1 = hash_table_find_entry(drawing->point_table, drawing->lines[i].label1);
+        HashEntry* entry2 = hash_table_find_entry(drawing->point_table, drawing->lines[i].label2);
+        if (!entry1 || !entry2 || drawing->point_flags[entry1->index] || drawing->point_flags[entry2->index]) continue;
+        Sint32* line = density->endpoints + 4 * density->line_count++;
+        line[0] = entry1->point.x;
+        line[1] = entry1->point.y;
+        line[2] = entry2->point.x;
+        line[3] = entry2->point.y;
+    }
+    parallel_for(density->height, 16, line_density_band_task, density);
+
+    Uint32 max_count = 0;
+    size_t cells = (size_t)density->width * density->height;
+    for (size_t i = 0; i < cells; ++i) {
+        if (density->counts[i] > max_count) max_count = density->counts[i];
+    }
+    LineDensityColorContext color = {density, NULL, 0, max_count ? 1 / logf(1.0f + max_count) : 0};
+    void* pixels;
+    if (SDL_LockTexture(density->texture, NULL, &pixels, &color.pitch) != 0) {
+        fprintf(stderr, "Failed to lock line density texture! SDL Error: %s\n", SDL_GetError());
+        return;
+    }
+    color.pixels = pixels;
+    parallel_for(density->height, 16, line_density_color_task, &color);
+    SDL_UnlockTexture(density->texture);
+    density->revision = drawing->revision;
+    density->built = true;
+}
+
+// --- Minimap Functions ---
+void minimap_init(Minimap* minimap, int image_width, int image_height) {
+    memset(minimap, 0, sizeof(Minimap));
+    int longest = image_width > image_height ? image_width : image_height;
+    minimap->scale = longest > MINIMAP_SIZE ? (double)MINIMAP_SIZE / longest : 1.0;
+    minimap->pane.w = (int)lround(image_width * minimap->scale);
+    minimap->pane.h = (int)lround(image_height * minimap->scale);
+    if (minimap->pane.w < 1) minimap->pane.w = 1;
+    if (minimap->pane.h < 1) minimap->pane.h = 1;
+}
+
+// Where the composite sits inside a view's pane (pane-local coordinates)
+SDL_Rect minimap_rect(const Minimap* minimap, const Viewport* view) {
+    SDL_Rect rect = {view->pane.w - minimap->pane.w - 10, 10, minimap->pane.w, minimap->pane.h};
+    return rect;
+}
+
+void minimap_free(Minimap* minimap) {
+    if (minimap->texture) SDL_DestroyTexture(minimap->texture);
+    minimap->texture = NULL;
+}
+
+// Redraws the composite (image scaled down, then lines and points) into the cached texture
+// when the drawing changed; at other times the pane costs one texture copy per frame
+void minimap_update(SDL_Renderer* renderer, Minimap* minimap, SDL_Texture* image_texture, const Drawing* drawing) {
+    if (minimap->built && minimap->revision == drawing->revision) return;
+    if (!minimap->texture) {
+        minimap->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, minimap->pane.w, minimap->pane.h);
+        if (!minimap->texture) {
+            fprintf(stderr, "Failed to create minimap texture! SDL Error: %s\n", SDL_GetError());
+            minimap->built = true; // Don't retry every frame
+            minimap->revision = drawing->revision;
+            return;
+        }
+    }
+    SDL_SetRenderTarget(renderer, minimap->texture);
+    set_draw_color(renderer, COLOR_WHITE_BG);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, image_texture, NULL, NULL);
+    Viewport view = {0, 0, minimap->scale};
+    set_draw_color(renderer, COLOR_RED);
+    for (int i = 0; i < drawing->line_count; ++i) {
+        if (!line_is_visible(drawing, drawing->lines[i])) continue;
+        Point* p1 = hash_table_get(drawing->point_table, drawing->lines[i].label1);
+        Point* p2 = hash_table_get(drawing->point_table, drawing->lines[i].label2);
+        int x1, y1, x2, y2;
+        viewport_to_screen(&view, p1->x, p1->y, &x1, &y1);
+        viewport_to_screen(&view, p2->x, p2->y, &x2, &y2);
+        SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+    }
+    set_draw_color(renderer, COLOR_BLACK);
+    for (int i = 0; i < drawing->point_count; ++i) {
+        if (drawing->point_flags[i]) continue;
+        int x, y;
+        viewport_to_screen(&view, drawing->points[i].x, drawing->points[i].y, &x, &y);
+        SDL_RenderDrawPoint(renderer, x, y);
+    }
+    SDL_SetRenderTarget(renderer, NULL);
+    minimap->revision = drawing->revision;
+    minimap->built = true;
+}
+
+// Copies the composite into the view's pane and outlines the part of the image the view shows;
+// expects the renderer viewport to be set to view->pane
+void minimap_draw(SDL_Renderer* renderer, const Minimap* minimap, const Viewport* view) {
+    if (!minimap->texture) return;
+    SDL_Rect rect = minimap_rect(minimap, view);
+    SDL_RenderCopy(renderer, minimap->texture, NULL, &rect);
+    set_draw_color(renderer, COLOR_BLACK);
+    SDL_Rect border = {rect.x - 1, rect.y - 1, rect.w + 2, rect.h + 2};
+    SDL_RenderDrawRect(renderer, &border);
+    SDL_Rect visible = {rect.x + (int)lround(view->x * minimap->scale), rect.y + (int)lround(view->y * minimap->scale),
+                        (int)lround(view->pane.w / view->zoom * minimap->scale) + 1, (int)lround(view->pane.h / view->zoom * minimap->scale) + 1};
+    SDL_RenderSetClipRect(renderer, &rect);
+    set_draw_color(renderer, COLOR_RED);
+    SDL_RenderDrawRect(renderer, &visible);
+    SDL_RenderSetClipRect(renderer, NULL);
+}
+
+// Returns true and the image point under the pane-local point when it is inside the view's minimap
+bool minimap_hit(const Minimap* minimap, const Viewport* view, int local_x, int local_y, double* x, double* y) {
+    SDL_Rect rect = minimap_rect(minimap, view);
+    SDL_Point point = {local_x, local_y};
+    if (!SDL_PointInRect(&point, &rect)) return false;
+    *x = (local_x - rect.x) / minimap->scale;
+    *y = (local_y - rect.y) / minimap->scale;
+    return true;
+}
+
+// Splits the window into view_count side-by-side panes
+void layout_views(Viewport* views, int view_count, int window_width, int window_height) {
+    int width = window_width / view_count;
+    for (int i = 0; i < view_count; ++i) {
+        views[i].pane.x = i * width;
+        views[i].pane.y = 0;
+        views[i].pane.w = i == view_count - 1 ? window_width - i * width : width;
+        views[i].pane.h = window_height;
+    }
+}
+
+// --- Image Adjustment Functions ---
+// Gain alone maps to color modulation plus at most one additive copy
+bool adjustment_uses_color_mod(const ImageAdjustment* adjustment) {
+    return adjustment->contrast == 1 && adjustment->gamma == 1 && adjustment->gain <= 2;
+}
+
+void adjustment_build_lut(const ImageAdjustment* adjustment, Uint8* lut) {
+    for (int i = 0; i < 256; ++i) {
+        double value = i / 255.0 * adjustment->gain;
+        value = (value - 0.5) * adjustment->contrast + 0.5;
+        if (value < 0) value = 0;
+        if (value > 1) value = 1;
+        lut[i] = (Uint8)lround(pow(value, 1.0 / adjustment->gamma) * 255);
+    }
+}
+
+// Copies texture with its color scaled by gain: modulation covers gain <= 1, and a second,
+// additive copy adds the part above 1
+void render_copy_gain(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* source, const SDL_Rect* destination, float gain) {
+    if (gain == 1) {
+        SDL_RenderCopy(renderer, texture, source, destination);
+        return;
+    }
+    Uint8 base = (Uint8)lround((gain < 1 ? gain : 1) * 255);
+    SDL_SetTextureColorMod(texture, base, base, base);
+    SDL_RenderCopy(renderer, texture, source, destination);
+    if (gain > 1) {
+        Uint8 extra = (Uint8)lround((gain < 2 ? gain - 1 : 1) * 255); // One added copy reaches at most gain 2
+        SDL_BlendMode mode;
+        SDL_GetTextureBlendMode(texture, &mode);
+        SDL_SetTextureColorMod(texture, extra, extra, extra);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_ADD);
+        SDL_RenderCopy(renderer, texture, source, destination);
+        SDL_SetTextureBlendMode(texture, mode);
+    }
+    SDL_SetTextureColorMod(texture, 255, 255, 255);
+}
+
+typedef struct {
+    ImageAdjuster* adjuster;
+    const Uint8* lut;
+    int tile_row;
+} AdjustTileContext;
+
+// Adjusts each tile into a private buffer, then publishes the tiles that changed under the
+// lock the render thread holds while uploading. Only workers write output, each its own
+// tiles, so comparing against it without the lock is safe.
+void adjust_tiles_task(void* data, int worker, int begin, int end) {
+    AdjustTileContext* context = data;
+    ImageAdjuster* adjuster = context->adjuster;
+    const SDL_Surface* source = adjuster->source;
+    const Uint8* lut = context->lut;
+    Uint32* pixels = malloc(ADJUST_TILE_SIZE * ADJUST_TILE_SIZE * sizeof(Uint32));
+    int y0 = context->tile_row * ADJUST_TILE_SIZE;
+    int y1 = y0 + ADJUST_TILE_SIZE < source->h ? y0 + ADJUST_TILE_SIZE : source->h;
+    for (int tile = begin; tile < end; ++tile) {
+        int x0 = tile * ADJUST_TILE_SIZE;
+        int x1 = x0 + ADJUST_TILE_SIZE < source->w ? x0 + ADJUST_TILE_SIZE : source->w;
+        bool changed = false;
+        for (int y = y0; y < y1; ++y) {
+            const Uint32* in = (const Uint32*)((const Uint8*)source->pixels + y * source->pitch);
+            const Uint32* current = adjuster->output + (size_t)y * source->w;
+            Uint32* out = pixels + (y - y0) * ADJUST_TILE_SIZE;
+            for (int x = x0; x < x1; ++x) {
+                Uint32 pixel = in[x];
+                Uint32 adjusted = (pixel & 0xFF000000) | ((Uint32)lut[(pixel >> 16) & 0xFF] << 16) |
+                                  ((Uint32)lut[(pixel >> 8) & 0xFF] << 8) | lut[pixel & 0xFF];
+                changed |= adjusted != current[x];
+                out[x - x0] = adjusted;
+            }
+        }
+        if (!changed) continue;
+        SDL_LockMutex(adjuster->lock);
+        for (int y = y0; y < y1; ++y) {
+            memcpy(adjuster->output + (size_t)y * source->w + x0, pixels + (y - y0) * ADJUST_TILE_SIZE, (x1 - x0) * sizeof(Uint32));
+        }
+        adjuster->tile_dirty[context->tile_row * adjuster->tile_columns + tile] = true;
+        SDL_UnlockMutex(adjuster->lock);
+    }
+    free(pixels);
+}
+
+int image_adjuster_thread(void* data) {
+    ImageAdjuster* adjuster = data;
+    unsigned int done = 0;
+    for (;;) {
+        SDL_LockMutex(adjuster->lock);
+        while (adjuster->generation == done && !adjuster->stop) {
+            SDL_CondWait(adjuster->changed, adjuster->lock);
+        }
+        bool stop = adjuster->stop;
+        unsigned int generation = adjuster->generation;
+        ImageAdjustment adjustment = adjuster->requested;
+        SDL_UnlockMutex(adjuster->lock);
+        if (stop) break;
+
+        Uint8 lut[256];
+        adjustment_build_lut(&adjustment, lut);
+        bool superseded = false;
+        for (int row = 0; row < adjuster->tile_rows && !superseded; ++row) {
+            AdjustTileContext context = {adjuster, lut, row};
+            parallel_for(adjuster->tile_columns, 1, adjust_tiles_task, &context);
+            SDL_LockMutex(adjuster->lock);
+            superseded = adjuster->generation != generation || adjuster->stop;
+            SDL_UnlockMutex(adjuster->lock);
+        }
+        if (!superseded) done = generation;
+    }
+    return 0;
+}
+
+void image_adjuster_init(ImageAdjuster* adjuster, const SDL_Surface* source) {
+    memset(adjuster, 0, sizeof(ImageAdjuster));
+    adjuster->source = source;
+}
+
+void image_adjuster_free(ImageAdjuster* adjuster) {
+    if (adjuster->thread) {
+        SDL_LockMutex(adjuster->lock);
+        adjuster->stop = true;
+        SDL_CondSignal(adjuster->changed);
+        SDL_UnlockMutex(adjuster->lock);
+        SDL_WaitThread(adjuster->thread, NULL);
+    }
+    if (adjuster->changed) SDL_DestroyCond(adjuster->changed);
+    if (adjuster->lock) SDL_DestroyMutex(adjuster->lock);
+    if (adjuster->texture) SDL_DestroyTexture(adjuster->texture);
+    free(adjuster->output);
+    free(adjuster->tile_dirty);
+    memset(adjuster, 0, sizeof(ImageAdjuster));
+}
+
+// Starts the worker on first use; the output begins as a copy of the source, so tiles
+// that haven't been processed yet show the unadjusted image
+bool image_adjuster_start(ImageAdjuster* adjuster, SDL_Renderer* renderer) {
+    const SDL_Surface* source = adjuster->source;
+    if (adjuster->thread) return true;
+    if (!source || adjuster->failed) return false;
+    adjuster->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, source->w, source->h);
+    adjuster->output = malloc((size_t)source->w * source->h * sizeof(Uint32));
+    if (!adjuster->texture || !adjuster->output) {
+        fprintf(stderr, "Failed to allocate adjusted image! SDL Error: %s\n", SDL_GetError());
+        image_adjuster_free(adjuster);
+        adjuster->source = source;
+        adjuster->failed = true; // Don't retry on every key press
+        return false;
+    }
+    for (int y = 0; y < source->h; ++y) {
+        memcpy(adjuster->output + (size_t)y * source->w, (const Uint8*)source->pixels + y * source->pitch, source->w * sizeof(Uint32));
+    }
+    SDL_UpdateTexture(adjuster->texture, NULL, adjuster->output, source->w * sizeof(Uint32));
+    adjuster->tile_columns = (source->w + ADJUST_TILE_SIZE - 1) / ADJUST_TILE_SIZE;
+    adjuster->tile_rows = (source->h + ADJUST_TILE_SIZE - 1) / ADJUST_TILE_SIZE;
+    adjuster->tile_dirty = calloc((size_t)adjuster->tile_columns * adjuster->tile_rows, sizeof(bool));
+    adjuster->lock = SDL_CreateMutex();
+    adjuster->changed = SDL_CreateCond();
+    adjuster->thread = SDL_CreateThread(image_adjuster_thread, "adjust", adjuster);
+    if (!adjuster->thread) {
+        fprintf(stderr, "Failed to start image adjustment thread! SDL Error: %s\n", SDL_GetError());
+        image_adjuster_free(adjuster);
+        adjuster->source = source;
+        adjuster->failed = true;
+        return false;
+    }
+    return true;
+}
+
+// Hands a new lookup-table adjustment to the worker, replacing any pass in progress
+void image_adjuster_request(ImageAdjuster* adjuster, SDL_Renderer* renderer, const ImageAdjustment* adjustment) {
+    if (!image_adjuster_start(adjuster, renderer)) return;
+    SDL_LockMutex(adjuster->lock);
+    adjuster->requested = *adjustment;
+    adjuster->generation++;
+    SDL_CondSignal(adjuster->changed);
+    SDL_UnlockMutex(adjuster->lock);
+}
+
+// Uploads the tiles the worker has changed since the last call
+void image_adjuster_upload(ImageAdjuster* adjuster) {
+    if (!adjuster->thread) return;
+    int width = adjuster->source->w, height = adjuster->source->h;
+    SDL_LockMutex(adjuster->lock);
+    for (int i = 0; i < adjuster->tile_columns * adjuster->tile_rows; ++i) {
+        if (!adjuster->tile_dirty[i]) continue;
+        SDL_Rect tile = {(i % adjuster->tile_columns) * ADJUST_TILE_SIZE, (i / adjuster->tile_columns) * ADJUST_TILE_SIZE, ADJUST_TILE_SIZE, ADJUST_TILE_SIZE};
+        if (tile.x + tile.w > width) tile.w = width - tile.x;
+        if (tile.y + tile.h > height) tile.h = height - tile.y;
+        SDL_UpdateTexture(adjuster->texture, &tile, adjuster->output + (size_t)tile.y * width + tile.x, width * sizeof(Uint32));
+        adjuster->tile_dirty[i] = false;
+    }
+    SDL_UnlockMutex(adjuster->lock);
+}
+
+// --- Comparison Functions ---
+typedef struct {
+    const SDL_Surface* first;
+    const SDL_Surface* second;
+    SDL_Surface* output;
+} DifferenceContext;
+
+void difference_task(void* data, int worker, int begin, int end) {
+    DifferenceContext* context = data;
+    for (int y = begin; y < end; ++y) {
+        const Uint32* a = (const Uint32*)((const Uint8*)context->first->pixels + y * context->first->pitch);
+        const Uint32* b = (const Uint32*)((const Uint8*)context->second->pixels + y * context->second->pitch);
+        Uint32* out = (Uint32*)((Uint8*)context->output->pixels + y * context->output->pitch);
+        for (int x = 0; x < context->output->w; ++x) {
+            Uint32 pixel = 0xFF000000;
+            for (int shift = 0; shift < 24; shift += 8) {
+                int delta = (int)((a[x] >> shift) & 0xFF) - (int)((b[x] >> shift) & 0xFF);
+                pixel |= (Uint32)abs(delta) << shift;
+            }
+            out[x] = pixel;
+        }
+    }
+}
+
+// Loads the second image, scaled to base's size, and builds its texture and the difference texture
+bool comparison_init(Comparison* comparison, SDL_Renderer* renderer, SDL_Surface* base, const char* path) {
+    memset(comparison, 0, sizeof(Comparison));
+    comparison->swipe_x = base->w / 2.0;
+    SDL_Surface* loaded = IMG_Load(path);
+    if (!loaded) {
+        fprintf(stderr, "Failed to load comparison image %s! IMG_Error: %s\n", path, IMG_GetError());
+        return false;
+    }
+    SDL_Surface* first = SDL_ConvertSurfaceFormat(base, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_Surface* second = SDL_CreateRGBSurfaceWithFormat(0, base->w, base->h, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Surface* difference = SDL_CreateRGBSurfaceWithFormat(0, base->w, base->h, 32, SDL_PIXELFORMAT_ARGB8888);
+    bool ok = first && second && difference;
+    if (ok && (loaded->w != base->w || loaded->h != base->h)) {
+        fprintf(stderr, "Warning: %s is %dx%d; scaling it to %dx%d for comparison\n", path, loaded->w, loaded->h, base->w, base->h);
+    }
+    if (ok) ok = SDL_BlitScaled(loaded, NULL, second, NULL) == 0; // Converts the format as well
+    if (ok) {
+        DifferenceContext context = {first, second, difference};
+        parallel_for(base->h, 64, difference_task, &context);
+        comparison->texture = SDL_CreateTextureFromSurface(renderer, second);
+        comparison->difference = SDL_CreateTextureFromSurface(renderer, difference);
+        ok = comparison->texture && comparison->difference;
+    }
+    if (ok) {
+        comparison->surface = second;
+        second = NULL;
+    }
+    if (!ok) fprintf(stderr, "Failed to prepare comparison image %s! SDL Error: %s\n", path, SDL_GetError());
+    SDL_FreeSurface(loaded);
+    if (first) SDL_FreeSurface(first);
+    if (second) SDL_FreeSurface(second);
+    if (difference) SDL_FreeSurface(difference);
+    return ok;
+}
+
+void comparison_free(Comparison* comparison) {
+    if (comparison->texture) SDL_DestroyTexture(comparison->texture);
+    if (comparison->difference) SDL_DestroyTexture(comparison->difference);
+    if (comparison->surface) SDL_FreeSurface(comparison->surface);
+    comparison->texture = comparison->difference = NULL;
+    comparison->surface = NULL;
+}
+
+// Draws the base layer of one view: the first image, or a composite of both in comparison modes.
+// The caller passes both images with the same adjustment applied, and gain on top of that.
+void comparison_draw(SDL_Renderer* renderer, const Comparison* comparison, SDL_Texture* image_texture, SDL_Texture* second_texture,
+                     const Viewport* view, int image_width, int image_height, float gain) {
+    SDL_Rect image_rect = viewport_image_rect(view, image_width, image_height);
+    switch (comparison->mode) {
+        case COMPARE_SWIPE: {
+            render_copy_gain(renderer, image_texture, NULL, &image_rect, gain);
+            int split = (int)lround(comparison->swipe_x);
+            if (split < 0) split = 0;
+            if (split > image_width) split = image_width;
+            int screen_x, screen_y;
+            viewport_to_screen(view, split, 0, &screen_x, &screen_y);
+            SDL_Rect source = {split, 0, image_width - split, image_height};
+            SDL_Rect destination = {screen_x, image_rect.y, image_rect.x + image_rect.w - screen_x, image_rect.h};
+            if (source.w > 0) render_copy_gain(renderer, second_texture, &source, &destination, gain);
+            set_draw_color(renderer, COLOR_WHITE_BG);
+            SDL_RenderDrawLine(renderer, screen_x, image_rect.y, screen_x, image_rect.y + image_rect.h);
+            break;
+        }
+        case COMPARE_FLICKER: {
+            bool second = (SDL_GetTicks() / FLICKER_INTERVAL_MS) & 1;
+            render_copy_gain(renderer, second ? second_texture : image_texture, NULL, &image_rect, gain);
+            break;
+        }
+        case COMPARE_DIFFERENCE:
+            SDL_RenderCopy(renderer, comparison->difference, NULL, &image_rect);
+            break;
+        default:
+            render_copy_gain(renderer, image_texture, NULL, &image_rect, gain);
+            break;
+    }
+}
+
+// --- Histogram Functions ---
+typedef struct {
+    const SDL_Surface* source;
+    Uint32 (*partial)[3][256]; // One set of histograms per worker, merged afterwards
+} HistogramContext;
+
+void histogram_rows_task(void* data, int worker, int begin, int end) {
+    HistogramContext* context = data;
+    Uint32 (*counts)[256] = context->partial[worker];
+    const SDL_Surface* source = context->source;
+    for (int y = begin; y < end; ++y) {
+        const Uint32* row = (const Uint32*)((const Uint8*)source->pixels + y * source->pitch);
+        for (int x = 0; x < source->w; ++x) {
+            counts[0][(row[x] >> 16) & 0xFF]++;
+            counts[1][(row[x] >> 8) & 0xFF]++;
+            counts[2][row[x] & 0xFF]++;
+        }
+    }
+}
+
+int histogram_thread(void* data) {
+    Histogram* histogram = data;
+    int workers = parallel_worker_count(histogram->source->h, 64);
+    HistogramContext context = {histogram->source, calloc(workers, sizeof(*context.partial))};
+    if (!context.partial) return 0;
+    parallel_for(histogram->source->h, 64, histogram_rows_task, &context);
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+    for (int w = 0; w < workers; ++w) {
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < 256; ++i) histogram->counts[c][i] += context.partial[w][c][i];
+        }
+    }
+    free(context.partial);
+    SDL_AtomicSet(&histogram->ready, 1);
+    return 0;
+}
+
+void histogram_init(Histogram* histogram, const SDL_Surface* source) {
+    memset(histogram, 0, sizeof(Histogram));
+    histogram->source = source;
+}
+
+// Starts the background pass; call once the first frame is on screen
+void histogram_start(Histogram* histogram) {
+    if (histogram->started || !histogram->source) return;
+    histogram->started = true;
+    histogram->thread = SDL_CreateThread(histogram_thread, "histogram", histogram);
+    if (!histogram->thread) histogram_thread(histogram); // Compute inline if the thread can't start
+}
+
+bool histogram_ready(Histogram* histogram) {
+    return SDL_AtomicGet(&histogram->ready) != 0;
+}
+
+void histogram_free(Histogram* histogram) {
+    if (histogram->thread) SDL_WaitThread(histogram->thread, NULL);
+    histogram->thread = NULL;
+}
+
+// Level at which the cumulative count of channel c first exceeds target
+int histogram_percentile(const Histogram* histogram, int c, double target) {
+    double cumulative = 0;
+    for (int i = 0; i < 256; ++i) {
+        cumulative += histogram->counts[c][i];
+        if (cumulative > target) return i;
+    }
+    return 255;
+}
+
+// Stretches the range between the darkest and brightest AUTO_CONTRAST_CLIP of all channels
+// to full scale, expressed as gain and contrast. Returns false until the histogram is ready.
+bool histogram_auto_contrast(Histogram* histogram, ImageAdjustment* adjustment) {
+    if (!histogram_ready(histogram)) return false;
+    double total = (double)histogram->source->w * histogram->source->h;
+    int low = 255, high = 0;
+    for (int c = 0; c < 3; ++c) {
+        int channel_low = histogram_percentile(histogram, c, total * AUTO_CONTRAST_CLIP);
+        int channel_high = histogram_percentile(histogram, c, total * (1 - AUTO_CONTRAST_CLIP));
+        if (channel_low < low) low = channel_low;
+        if (channel_high > high) high = channel_high;
+    }
+    if (high <= low) return false; // Flat image
+    // Solve (v * gain - 0.5) * contrast + 0.5 for low -> 0 and high -> 1
+    double lo = low / 255.0, hi = high / 255.0;
+    double contrast = 2 * lo / (hi - lo) + 1;
+    adjustment->gain = (float)(1 / ((hi - lo) * contrast));
+    adjustment->contrast = (float)contrast;
+    adjustment->gamma = 1;
+    return true;
+}
+
+// Draws the three channel histograms as overlaid square-root-scaled curves
+void draw_histogram(SDL_Renderer* renderer, Histogram* histogram, int x, int y) {
+    if (!histogram_ready(histogram)) return;
+    SDL_Rect frame = {x, y, 256 + 2, HISTOGRAM_HEIGHT + 2};
+    set_draw_color(renderer, COLOR_WHITE_BG);
+    SDL_RenderFillRect(renderer, &frame);
+    set_draw_color(renderer, COLOR_BLACK);
+    SDL_RenderDrawRect(renderer, &frame);
+    Uint32 peak = 1;
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 256; ++i) {
+            if (histogram->counts[c][i] > peak) peak = histogram->counts[c][i];
+        }
+    }
+    const SDL_Color colors[3] = {{220, 0, 0, 255}, {0, 160, 0, 255}, {0, 0, 220, 255}};
+    SDL_Point curve[256];
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 256; ++i) {
+            curve[i].x = x + 1 + i;
+            curve[i].y = y + HISTOGRAM_HEIGHT - (int)lround(sqrt((double)histogram->counts[c][i] / peak) * (HISTOGRAM_HEIGHT - 1));
+        }
+        set_draw_color(renderer, colors[c]);
+        SDL_RenderDrawLines(renderer, curve, 256);
+    }
+}
+
+// --- HUD Functions ---
+// Reads one pixel from the retained ARGB8888 copy; no GPU readback
+bool image_pixel_at(const SDL_Surface* surface, int x, int y, SDL_Color* color) {
+    if (!surface || x < 0 || y < 0 || x >= surface->w || y >= surface->h) return false;
+    Uint32 pixel = ((const Uint32*)((const Uint8*)surface->pixels + y * surface->pitch))[x];
+    color->r = (pixel >> 16) & 0xFF;
+    color->g = (pixel >> 8) & 0xFF;
+    color->b = pixel & 0xFF;
+    color->a = pixel >> 24;
+    return true;
+}
+
+void draw_hud(SDL_Renderer* renderer, TTF_Font* font, const Hud* hud, const SDL_Surface* image_surface, Histogram* histogram) {
+    if (!hud->enabled) return;
+    draw_histogram(renderer, histogram, 10, 10 + FONT_SIZE + 8);
+    SDL_Color pixel;
+    if (!hud->has_cursor) return;
+    if (!image_pixel_at(image_surface, hud->cursor_x, hud->cursor_y, &pixel)) return;
+    char text[128];
+    snprintf(text, sizeof(text), "(%d, %d) RGB %d %d %d #%02X%02X%02X", hud->cursor_x, hud->cursor_y, pixel.r, pixel.g, pixel.b, pixel.r, pixel.g, pixel.b);
+    SDL_Rect swatch = {10, 10, FONT_SIZE, FONT_SIZE};
+    set_draw_color(renderer, COLOR_BLACK);
+    SDL_RenderDrawRect(renderer, &swatch);
+    SDL_Rect fill = {swatch.x + 1, swatch.y + 1, swatch.w - 2, swatch.h - 2};
+    pixel.a = 255;
+    set_draw_color(renderer, pixel);
+    SDL_RenderFillRect(renderer, &fill);
+    draw_text(renderer, font, text, swatch.x + swatch.w + 6, swatch.y, COLOR_BLACK);
+}
+
+// --- Frame Export Functions ---
+typedef struct {
+    const SDL_Surface* surface; // ARGB8888
+    unsigned char* output;
+    FrameFormat format;
+} FrameConvertContext;
+
+// Converts rows [begin, end) to packed RGB (PPM) or to the three planes of YUV 4:4:4 (Y4M, BT.601 studio range)
+void frame_convert_task(void* data, int worker, int begin, int end) {
+    FrameConvertContext* context = data;
+    const SDL_Surface* surface = context->surface;
+    int plane_size = surface->w * surface->h;
+    for (int y = begin; y < end; ++y) {
+        const Uint32* row = (const Uint32*)((const Uint8*)surface->pixels + y * surface->pitch);
+        for (int x = 0; x < surface->w; ++x) {
+            int r = (row[x] >> 16) & 0xFF, g = (row[x] >> 8) & 0xFF, b = row[x] & 0xFF;
+            int i = y * surface->w + x;
+            if (context->format == FRAME_FORMAT_PPM) {
+                context->output[3 * i] = r;
+                context->output[3 * i + 1] = g;
+                context->output[3 * i + 2] = b;
+            } else {
+                // BT.601 integer form; the shift floors negative chroma sums where division would truncate
+                context->output[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+                context->output[plane_size + i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+                context->output[2 * plane_size + i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+            }
+        }
+    }
+}
+
+// Writes the accumulation surface as one frame; scratch holds 3 bytes per pixel
+void write_frame(BufferedWriter* writer, FrameFormat format, const SDL_Surface* surface, unsigned char* scratch) {
+    FrameConvertContext context = {surface, scratch, format};
+    parallel_for(surface->h, 64, frame_convert_task, &context);
+    if (format == FRAME_FORMAT_PPM) {
+        writer_printf(writer, "P6\n%d %d\n255\n", surface->w, surface->h);
+    } else {
+        writer_printf(writer, "FRAME\n");
+    }
+    writer_write(writer, scratch, (size_t)surface->w * surface->h * 3);
+}
+
+// Renders the drawing growing point by point onto a persistent copy of the image. Each frame
+// draws only the points added since the previous one, plus the lines whose later endpoint is
+// among them, so the cost per frame is the new elements and the frame copy, not the drawing.
+// In time order, points without a time come first, then the time index.
+bool export_frames(const Options* options, Drawing* drawing, SDL_Surface* canvas, TTF_Font* font) {
+    SDL_Renderer* renderer = SDL_CreateSoftwareRenderer(canvas);
+    if (!renderer) {
+        fprintf(stderr, "Software renderer could not be created! SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+    BufferedWriter writer;
+    if (!writer_open(&writer, options->frames_path)) {
+        SDL_DestroyRenderer(renderer);
+        return false;
+    }
+
+    int point_count = drawing->point_count;
+    int* point_order = malloc((point_count + 1) * sizeof(int)); // Frame position -> point
+    int* point_rank = malloc((point_count + 1) * sizeof(int));  // Point -> frame position
+    int placed = 0;
+    if (options->frame_order_by_time) {
+        if (!drawing->time_index_valid) drawing_build_time_index(drawing);
+        for (int i = 0; i < point_count; ++i) {
+            if (isnan(drawing->points[i].time)) point_order[placed++] = i;
+        }
+        for (int i = 0; i < drawing->time_count; ++i) point_order[placed++] = drawing->time_index[i].point;
+    } else {
+        for (int i = 0; i < point_count; ++i) point_order[placed++] = i;
+    }
+    for (int i = 0; i < point_count; ++i) point_rank[point_order[i]] = i;
+
+    // Bucket lines by the position of their later endpoint (counting sort)
+    int* line_starts = calloc(point_count + 2, sizeof(int));
+    int* line_order = malloc((drawing->line_count + 1) * sizeof(int));
+    int* line_point = malloc((drawing->line_count + 1) * sizeof(int));
+    for (int i = 0; i < drawing->line_count; ++i) {
+        int index1 = point_rank[hash_table_find_entry(drawing->point_table, drawing->lines[i].label1)->index];
+        int index2 = point_rank[hash_table_find_entry(drawing->point_table, drawing->lines[i].label2)->index];
+        line_point[i] = index1 > index2 ? index1 : index2;
+        line_starts[line_point[i] + 2]++;
+    }
+    for (int i = 0; i < point_count; ++i) line_starts[i + 2] += line_starts[i + 1];
+    for (int i = 0; i < drawing->line_count; ++i) line_order[line_starts[line_point[i] + 1]++] = i;
+    free(line_point);
+    free(point_rank);
+
+    int step = options->frame_step > 0 ? options->frame_step : (point_count + 99) / 100;
+    if (step < 1) step = 1;
+    if (options->frame_format == FRAME_FORMAT_Y4M) {
+        writer_printf(&writer, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", canvas->w, canvas->h, options->frame_rate);
+    }
+    Viewport identity = {0, 0, 1, {0, 0, canvas->w, canvas->h}};
+    unsigned char* scratch = malloc((size_t)canvas->w * canvas->h * 3);
+    write_frame(&writer, options->frame_format, canvas, scratch); // The bare image
+    int frame_count = 1;
+    for (int begin = 0; begin < point_count && !writer.failed; begin += step) {
+        int end = begin + step < point_count ? begin + step : point_count;
+        for (int i = line_starts[begin]; i < line_starts[end]; ++i) {
+            if (!line_is_visible(drawing, drawing->lines[line_order[i]])) continue;
+            draw_thick_line(renderer, drawing->lines[line_order[i]], DRAW_LINE_THICKNESS, COLOR_RED, drawing->point_table, &identity);
+        }
+        for (int i = begin; i < end; ++i) {
+            if (drawing->point_flags[point_order[i]]) continue;
+            draw_point_with_label(renderer, drawing->points[point_order[i]], DRAW_POINT_RADIUS, COLOR_BLACK, font);
+        }
+        SDL_RenderFlush(renderer);
+        write_frame(&writer, options->frame_format, canvas, scratch);
+        frame_count++;
+    }
+    free(scratch);
+    free(point_order);
+    free(line_starts);
+    free(line_order);
+    SDL_DestroyRenderer(renderer);
+    bool ok = writer_close(&writer);
+    if (ok) {
+        fprintf(stderr, "Wrote %d frames (%dx%d) to %s\n", frame_count, canvas->w, canvas->h, options->frames_path);
+    } else {
+        fprintf(stderr, "Failed to write frames to %s\n", options->frames_path);
+    }
+    return ok;
+}
+
+// --- Edge Snapping Functions ---
+void edge_map_init(EdgeMap* map, const SDL_Surface* source) {
+    memset(map, 0, sizeof(EdgeMap));
+    if (!source) return;
+    map->source = source;
+    map->tile_columns = (source->w + EDGE_TILE_SIZE - 1) / EDGE_TILE_SIZE;
+    map->tile_rows = (source->h + EDGE_TILE_SIZE - 1) / EDGE_TILE_SIZE;
+    map->tiles = calloc((size_t)map->tile_columns * map->tile_rows, sizeof(Uint16*));
+}
+
+void edge_map_free(EdgeMap* map) {
+    for (int i = 0; map->tiles && i < map->tile_columns * map->tile_rows; ++i) free(map->tiles[i]);
+    free(map->tiles);
+    map->tiles = NULL;
+}
+
+// Luminance of the source pixel, with coordinates clamped to the image
+int edge_map_luma(const SDL_Surface* source, int x, int y) {
+    x = x < 0 ? 0 : x >= source->w ? source->w - 1 : x;
+    y = y < 0 ? 0 : y >= source->h ? source->h - 1 : y;
+    Uint32 pixel = ((const Uint32*)((const Uint8*)source->pixels + y * source->pitch))[x];
+    return (77 * ((pixel >> 16) & 0xFF) + 150 * ((pixel >> 8) & 0xFF) + 29 * (pixel & 0xFF)) >> 8;
+}
+
+// Computes one tile: luminance with a one-pixel border goes into a small buffer, then the
+// Sobel pass runs as plain row loops over it, which the compiler vectorizes
+const Uint16* edge_map_tile(EdgeMap* map, int tile_x, int tile_y) {
+    Uint16** slot = &map->tiles[tile_y * map->tile_columns + tile_x];
+    if (*slot) return *slot;
+    enum { STRIDE = EDGE_TILE_SIZE + 2 };
+    Uint8 luma[STRIDE * STRIDE];
+    int x0 = tile_x * EDGE_TILE_SIZE, y0 = tile_y * EDGE_TILE_SIZE;
+    for (int y = 0; y < STRIDE; ++y) {
+        for (int x = 0; x < STRIDE; ++x) luma[y * STRIDE + x] = edge_map_luma(map->source, x0 + x - 1, y0 + y - 1);
+    }
+    Uint16* magnitude = malloc(EDGE_TILE_SIZE * EDGE_TILE_SIZE * sizeof(Uint16));
+    for (int y = 0; y < EDGE_TILE_SIZE; ++y) {
+        const Uint8* above = luma + y * STRIDE;
+        const Uint8* middle = above + STRIDE;
+        const Uint8* below = middle + STRIDE;
+        Uint16* out = magnitude + y * EDGE_TILE_SIZE;
+        for (int x = 0; x < EDGE_TILE_SIZE; ++x) {
+            int gx = (above[x + 2] + 2 * middle[x + 2] + below[x + 2]) - (above[x] + 2 * middle[x] + below[x]);
+            int gy = (below[x] + 2 * below[x + 1] + below[x + 2]) - (above[x] + 2 * above[x + 1] + above[x + 2]);
+            out[x] = (Uint16)(abs(gx) + abs(gy));
+        }
+    }
+    *slot = magnitude;
+    return magnitude;
+}
+
+// Moves (x, y) to the strongest gradient within radius, if it is strong enough.
+// Returns true if the point moved.
+bool snap_to_edge(EdgeMap* map, int* x, int* y, int radius) {
+    if (!map->tiles) return false;
+    int best = SNAP_MIN_GRADIENT - 1, best_x = *x, best_y = *y, best_distance = 0;
+    int left = *x - radius < 0 ? 0 : *x - radius, right = *x + radius >= map->source->w ? map->source->w - 1 : *x + radius;
+    int top = *y - radius < 0 ? 0 : *y - radius, bottom = *y + radius >= map->source->h ? map->source->h - 1 : *y + radius;
+    for (int py = top; py <= bottom; ++py) {
+        for (int px = left; px <= right; ++px) {
+            int distance = (px - *x) * (px - *x) + (py - *y) * (py - *y);
+            if (distance > radius * radius) continue;
+            const Uint16* tile = edge_map_tile(map, px / EDGE_TILE_SIZE, py / EDGE_TILE_SIZE);
+            int value = tile[(py % EDGE_TILE_SIZE) * EDGE_TILE_SIZE + px % EDGE_TILE_SIZE];
+            if (value > best || (value == best && distance < best_distance)) { // Ties go to the nearer pixel
+                best = value;
+                best_x = px;
+                best_y = py;
+                best_distance = distance;
+            }
+        }
+    }
+    bool moved = best_x != *x || best_y != *y;
+    *x = best_x;
+    *y = best_y;
+    return moved;
+}
+
+// --- Edit Functions ---
+// Returns the index of the point closest to (x, y) within radius, or -1.
+int find_point_near(Point* points, int point_count, int x, int y, int radius) {
+    int best = -1;
+    int best_dist_sq = radius * radius;
+    for (int i = 0; i < point_count; ++i) {
+        int dx = points[i].x - x;
+        int dy = points[i].y - y;
+        int dist_sq = dx * dx + dy * dy;
+        if (dist_sq <= best_dist_sq) {
+            best = i;
+            best_dist_sq = dist_sq;
+        }
+    }
+    return best;
+}
+
+// Adds a point with the first free label of the form pN. Returns its index.
+int add_point(Drawing* drawing, int x, int y) {
+    char label[32];
+    int number = drawing->point_count + 1;
+    do {
+        snprintf(label, sizeof(label), "p%d", number++);
+    } while (hash_table_get(drawing->point_table, label));
+    bool duplicate;
+    Point point = {x, y, NULL, NAN};
+    HashEntry* entry = hash_table_insert(drawing->point_table, label, point, drawing->point_count, DUPLICATE_FIRST_WINS, &duplicate);
+    drawing_append_point(drawing, entry->point);
+    return entry->index;
+}
+
+// Removes a point, its table entry and every line that references it.
+void delete_point(Drawing* drawing, int index) {
+    const char* label = drawing->points[index].label;
+    int kept = 0;
+    for (int i = 0; i < drawing->line_count; ++i) {
+        Line* line = &drawing->lines[i];
+        if (strcmp(line->label1, label) == 0 || strcmp(line->label2, label) == 0) {
+            free(line->label1);
+            free(line->label2);
+        } else {
+            drawing->lines[kept++] = *line;
+        }
+    }
+    drawing->line_count = kept;
+
+    hash_table_delete(drawing->point_table, label); // Frees the label shared with points[index]
+    Point* points = drawing->points;
+    memmove(&points[index], &points[index + 1], (drawing->point_count - index - 1) * sizeof(Point));
+    int moved = drawing->point_count - index - 1;
+    memmove(&drawing->point_flags[index], &drawing->point_flags[index + 1], moved);
+    for (int i = 0; i < drawing->column_count; ++i) {
+        AttributeColumn* column = &drawing->columns[i];
+        if (column->type == ATTRIBUTE_NUMBER) {
+            memmove(&column->numbers[index], &column->numbers[index + 1], moved * sizeof(double));
+        } else {
+            memmove(&column->codes[index], &column->codes[index + 1], moved * sizeof(int));
+        }
+    }
+    drawing->point_count--;
+    drawing->time_index_valid = false; // Point indices shifted
+    drawing->revision++;
+    for (int i = index; i < drawing->point_count; ++i) {
+        hash_table_find_entry(drawing->point_table, points[i].label)->index = i;
+    }
+    if (drawing->seen_lines.keys) {
+        // Line keys are point indices, which just shifted
+        line_set_free(&drawing->seen_lines);
+        line_set_init(&drawing->seen_lines, 1024);
+        for (int i = 0; i < drawing->line_count; ++i) {
+            HashEntry* entry1 = hash_table_find_entry(drawing->point_table, drawing->lines[i].label1);
+            HashEntry* entry2 = hash_table_find_entry(drawing->point_table, drawing->lines[i].label2);
+            if (entry1 && entry2) line_set_add(&drawing->seen_lines, line_key(entry1->index, entry2->index));
+        }
+    }
+}
+
+// --- Save Screenshot Function ---
+bool save_screenshot(SDL_Renderer* renderer, int width, int height, const char* filename) {
+    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if (!surface) {
+        fprintf(stderr, "Failed to create surface for screenshot: %s\n", SDL_GetError());
+        return false;
+    }
+    if (SDL_RenderReadPixels(renderer, NULL, surface->format->format, surface->pixels, surface->pitch) != 0) {
+        fprintf(stderr, "Failed to read pixels from renderer for screenshot: %s\n", SDL_GetError());
+        SDL_FreeSurface(surface);
+        return false;
+    }
+    if (IMG_SavePNG(surface, filename) != 0) {
+        fprintf(stderr, "Failed to save surface as PNG: %s\n", IMG_GetError());
+        SDL_FreeSurface(surface);
+        return false;
+    }
+    SDL_FreeSurface(surface);
+    printf("Screenshot saved successfully to %s.\n", filename);
+    return true;
+}
+
+// --- Command Line ---
+void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [options] <image_file_path> [drawing_file.vd]\n", program);
+    fprintf(stderr, "       %s --check|--stats [options] [drawing_file.vd]\n", program);
+    fprintf(stderr, "       %s --svg=OUT.svg [options] <image_file_path> [drawing_file.vd]\n", program);
+    fprintf(stderr, "       %s --frames=OUT|- [options] <image_file_path> [drawing_file.vd]\n", program);
+    fprintf(stderr, "       %s --serve=SOCKET [--workers=N] [--image-cache-mb=N] [--drawing-cache-mb=N]\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --check                        Validate the drawing file and exit without opening a window\n");
+    fprintf(stderr, "  --stats                        Print drawing statistics as JSON and exit without opening a window\n");
+    fprintf(stderr, "  --duplicates=error|first|last  How repeated point labels are resolved (default: last)\n");
+    fprintf(stderr, "  --dedup-lines                  Drop repeated lines, treating line(a,b) and line(b,a) as equal\n");
+    fprintf(stderr, "  --points=FILE.csv              Import label,x,y rows (may be gzip-compressed)\n");
+    fprintf(stderr, "  --edges=FILE.csv               Import label1,label2 rows, after all points are loaded\n");
+    fprintf(stderr, "  --geojson=FILE.json            Import Point, LineString and Polygon features (pixel coordinates)\n");
+    fprintf(stderr, "  --heatmap                      Start with the point density heatmap ('h' toggles, '[' ']' blur)\n");
+    fprintf(stderr, "  --filter=EXPR                  Show only points whose key=value attributes match, e.g. \"score>0.8 && class==3\"\n");
+    fprintf(stderr, "  --svg=OUT.svg                  Export the drawing as SVG (\"-\" for stdout) and exit without opening a window\n");
+    fprintf(stderr, "  --svg-image=link|embed|none    How the SVG references the base image (default: link)\n");
+    fprintf(stderr, "  --frames=OUT                   Render the drawing point by point as a frame sequence (\"-\" for stdout)\n");
+    fprintf(stderr, "  --frame-format=y4m|ppm         Frame stream format (default: y4m)\n");
+    fprintf(stderr, "  --frame-order=file|time        Order points are added in (default: file)\n");
+    fprintf(stderr, "  --frame-step=N                 Points added per frame (default: about 100 frames in total)\n");
+    fprintf(stderr, "  --fps=N                        Frame rate written to the Y4M header (default: 25)\n");
+    fprintf(stderr, "  --compare=IMAGE                Load a second image for swipe, flicker and difference views ('c' cycles)\n");
+    fprintf(stderr, "  --serve=SOCKET                 Render jobs sent over a UNIX domain socket until interrupted\n");
+    fprintf(stderr, "  --workers=N                    Render server worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  --image-cache-mb=N             Render server budget for decoded images (default: 512)\n");
+    fprintf(stderr, "  --drawing-cache-mb=N           Render server budget for parsed drawings (default: 256)\n");
+}
+
+bool parse_options(int argc, char* argv[], Options* options) {
+    memset(options, 0, sizeof(Options));
+    options->load.duplicate_policy = DUPLICATE_LAST_WINS;
+    options->load.verbose = true;
+    options->frame_rate = 25;
+    options->image_cache_mb = 512;
+    options->drawing_cache_mb = 256;
+    int positional_count = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--duplicates=", strlen("--duplicates=")) == 0) {
+            const char* value = arg + strlen("--duplicates=");
+            if (strcmp(value, "error") == 0) {
+                options->load.duplicate_policy = DUPLICATE_ERROR;
+            } else if (strcmp(value, "first") == 0) {
+                options->load.duplicate_policy = DUPLICATE_FIRST_WINS;
+            } else if (strcmp(value, "last") == 0) {
+                options->load.duplicate_policy = DUPLICATE_LAST_WINS;
+            } else {
+                fprintf(stderr, "Unknown duplicate policy: %s\n", value);
+                return false;
+            }
+        } else if (strncmp(arg, "--points=", strlen("--points=")) == 0) {
+            options->points_csv_path = arg + strlen("--points=");
+        } else if (strncmp(arg, "--geojson=", strlen("--geojson=")) == 0) {
+            options->geojson_path = arg + strlen("--geojson=");
+        } else if (strncmp(arg, "--edges=", strlen("--edges=")) == 0) {
+            options->edges_csv_path = arg + strlen("--edges=");
+        } else if (strcmp(arg, "--dedup-lines") == 0) {
+            options->load.dedup_lines = true;
+        } else if (strcmp(arg, "--heatmap") == 0) {
+            options->heatmap = true;
+        } else if (strcmp(arg, "--check") == 0) {
+            options->check = true;
+        } else if (strcmp(arg, "--stats") == 0) {
+            options->stats = true;
+        } else if (strncmp(arg, "--filter=", strlen("--filter=")) == 0) {
+            options->filter = arg + strlen("--filter=");
+        } else if (strncmp(arg, "--svg=", strlen("--svg=")) == 0) {
+            options->svg_path = arg + strlen("--svg=");
+        } else if (strncmp(arg, "--svg-image=", strlen("--svg-image=")) == 0) {
+            const char* value = arg + strlen("--svg-image=");
+            if (strcmp(value, "link") == 0) {
+                options->svg_image = SVG_IMAGE_LINK;
+            } else if (strcmp(value, "embed") == 0) {
+                options->svg_image = SVG_IMAGE_EMBED;
+            } else if (strcmp(value, "none") == 0) {
+                options->svg_image = SVG_IMAGE_NONE;
+            } else {
+                fprintf(stderr, "Unknown SVG image mode: %s\n", value);
+                return false;
+            }
+        } else if (strncmp(arg, "--frames=", strlen("--frames=")) == 0) {
+            options->frames_path = arg + strlen("--frames=");
+        } else if (strncmp(arg, "--frame-format=", strlen("--frame-format=")) == 0) {
+            const char* value = arg + strlen("--frame-format=");
+            if (strcmp(value, "y4m") == 0) {
+                options->frame_format = FRAME_FORMAT_Y4M;
+            } else if (strcmp(value, "ppm") == 0) {
+                options->frame_format = FRAME_FORMAT_PPM;
+            } else {
+                fprintf(stderr, "Unknown frame format: %s\n", value);
+                return false;
+            }
+        } else if (strncmp(arg, "--frame-order=", strlen("--frame-order=")) == 0) {
+            const char* value = arg + strlen("--frame-order=");
+            if (strcmp(value, "file") == 0 || strcmp(value, "time") == 0) {
+                options->frame_order_by_time = strcmp(value, "time") == 0;
+            } else {
+                fprintf(stderr, "Unknown frame order: %s\n", value);
+                return false;
+            }
+        } else if (strncmp(arg, "--frame-step=", strlen("--frame-step=")) == 0) {
+            options->frame_step = atoi(arg + strlen("--frame-step="));
+        } else if (strncmp(arg, "--fps=", strlen("--fps=")) == 0) {
+            options->frame_rate = atoi(arg + strlen("--fps="));
+            if (options->frame_rate <= 0) {
+                fprintf(stderr, "Invalid frame rate: %s\n", arg);
+                return false;
+            }
+        } else if (strncmp(arg, "--compare=", strlen("--compare=")) == 0) {
+            options->compare_path = arg + strlen("--compare=");
+        } else if (strncmp(arg, "--serve=", strlen("--serve=")) == 0) {
+            options->serve_path = arg + strlen("--serve=");
+        } else if (strncmp(arg, "--workers=", strlen("--workers=")) == 0) {
+            options->server_workers = atoi(arg + strlen("--workers="));
+            if (options->server_workers <= 0) {
+                fprintf(stderr, "Invalid worker count: %s\n", arg);
+                return false;
+            }
+        } else if (strncmp(arg, "--image-cache-mb=", strlen("--image-cache-mb=")) == 0) {
+            options->image_cache_mb = atoi(arg + strlen("--image-cache-mb="));
+            if (options->image_cache_mb <= 0) {
+                fprintf(stderr, "Invalid image cache size: %s\n", arg);
+                return false;
+            }
+        } else if (strncmp(arg, "--drawing-cache-mb=", strlen("--drawing-cache-mb=")) == 0) {
+            options->drawing_cache_mb = atoi(arg + strlen("--drawing-cache-mb="));
+            if (options->drawing_cache_mb <= 0) {
+                fprintf(stderr, "Invalid drawing cache size: %s\n", arg);
+                return false;
+            }
+        } else if (strncmp(arg, "--", 2) == 0) {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return false;
+        } else if (positional_count == 0) {
+            options->image_path = arg;
+            positional_count++;
+        } else if (positional_count == 1) {
+            options->drawing_file_path = arg;
+            positional_count++;
+        } else {
+            fprintf(stderr, "Unexpected argument: %s\n", arg);
+            return false;
+        }
+    }
+    if (options->serve_path) return positional_count == 0; // Jobs name their own inputs
+    if (options->check || options->stats) {
+        // The only positional argument in the headless modes is the drawing file
+        options->drawing_file_path = options->image_path;
+        options->image_path = NULL;
+        options->load.verbose = false;
+        if (positional_count > 1) return false;
+        return options->drawing_file_path || options->points_csv_path || options->edges_csv_path || options->geojson_path;
+    }
+    return positional_count > 0;
+}
+
+// --- Check Mode ---
+// Parses and resolves the drawing without initializing SDL, so .vd files can be linted
+// on machines without a display. Returns the process exit code.
+int run_check(const Options* options) {
+    Drawing drawing;
+    drawing_init(&drawing);
+    bool ok = load_drawing(&drawing, options);
+    LoadStats stats = drawing.stats;
+    print_diagnostics(stderr, &drawing);
+    printf("%s: %d points, %d lines, %d duplicate labels, %d duplicate lines, %d errors, %d warnings\n",
+           primary_input(options), stats.points, stats.lines, stats.duplicate_labels, stats.duplicate_lines, stats.errors, stats.warnings);
+    FilterNode* filter;
+    if (apply_filter_option(&drawing, options, &filter)) {
+        if (filter) {
+            int matches = 0;
+            for (int i = 0; i < drawing.point_count; ++i) matches += !drawing.point_flags[i];
+            printf("%s: %d points match the filter\n", primary_input(options), matches);
+        }
+    } else {
+        ok = false;
+    }
+    free_filter(filter);
+    free_drawing(&drawing);
+    return ok ? 0 : 1;
+}
+
+// --- Stats Mode ---
+// Loads the drawing and prints DrawingStats as JSON on stdout, without initializing SDL
+int run_stats(const Options* options) {
+    Drawing drawing;
+    drawing_init(&drawing);
+    bool ok = load_drawing(&drawing, options);
+    DrawingStats stats;
+    compute_drawing_stats(&drawing, &stats);
+    print_drawing_stats_json(stdout, primary_input(options), &drawing, &stats);
+    free_drawing(&drawing);
+    return ok ? 0 : 1;
+}
+
+// --- SVG Mode ---
+// Loads the image only for its size (SDL_image needs no video subsystem) and writes the
+// drawing as SVG. Returns the process exit code.
+int run_svg_export(const Options* options) {
+    SDL_Surface* image = IMG_Load(options->image_path);
+    if (!image) {
+        fprintf(stderr, "Failed to load image %s! IMG_Error: %s\n", options->image_path, IMG_GetError());
+        return 1;
+    }
+    int width = image->w, height = image->h;
+    SDL_FreeSurface(image);
+
+    Drawing drawing;
+    drawing_init(&drawing);
+    bool ok = load_drawing(&drawing, options);
+    print_diagnostics(stderr, &drawing);
+    FilterNode* filter;
+    ok &= apply_filter_option(&drawing, options, &filter);
+    ok &= export_svg(options->svg_path, &drawing, options->image_path, options->svg_image, width, height);
+    free_filter(filter);
+    free_drawing(&drawing);
+    return ok ? 0 : 1;
+}
+
+// --- Frames Mode ---
+// Renders frames with a software renderer on a CPU surface; SDL_ttf and SDL_image work without
+// the video subsystem, so this runs on machines without a display. Returns the process exit code.
+int run_frames(const Options* options) {
+    if (TTF_Init() == -1) {
+        fprintf(stderr, "SDL_ttf could not initialize! TTF_Error: %s\n", TTF_GetError());
+        return 1;
+    }
+    SDL_Surface* loaded_surface = IMG_Load(options->image_path);
+    if (!loaded_surface) {
+        fprintf(stderr, "Failed to load image %s! IMG_Error: %s\n", options->image_path, IMG_GetError());
+        TTF_Quit();
+        return 1;
+    }
+    // The accumulation buffer: the image, with each frame's new elements drawn over it
+    SDL_Surface* canvas = SDL_ConvertSurfaceFormat(loaded_surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded_surface);
+    if (!canvas) {
+        fprintf(stderr, "Failed to convert image %s! SDL Error: %s\n", options->image_path, SDL_GetError());
+        TTF_Quit();
+        return 1;
+    }
+    TTF_Font* font = TTF_OpenFont(FONT_PATH, FONT_SIZE);
+    if (!font) {
+        fprintf(stderr, "Failed to load font %s! TTF_Error: %s\n", FONT_PATH, TTF_GetError());
+    }
+
+    Drawing drawing;
+    drawing_init(&drawing);
+    bool ok = load_drawing(&drawing, options);
+    print_diagnostics(stderr, &drawing);
+    FilterNode* filter;
+    ok &= apply_filter_option(&drawing, options, &filter);
+    ok &= export_frames(options, &drawing, canvas, font);
+    free_filter(filter);
+    free_drawing(&drawing);
+    if (font) TTF_CloseFont(font);
+    SDL_FreeSurface(canvas);
+    TTF_Quit();
+    return ok ? 0 : 1;
+}
+
+// --- Cache Functions ---
+void lru_cache_init(LruCache* cache, const char* name, size_t budget, CacheFreeValue free_value) {
+    memset(cache, 0, sizeof(LruCache));
+    cache->name = name;
+    cache->budget = budget;
+    cache->free_value = free_value;
+    cache->lock = SDL_CreateMutex();
 }
 
-Point* hash_table_get(HashTable* table, const char* label) {
-    unsigned int index = hash(label);
-    int attempts = 0;
-    while (table->entries[index].used && attempts < HASH_TABLE_SIZE) {
-        if (strcmp(table->entries[index].label, label) == 0) {
-            return &table->entries[index].point;
-        }
-        index = (index + 1) % HASH_TABLE_SIZE;
-        attempts++;
+// Removes entries[index] from the cache; its value is freed now or, if a job holds it, on release
+void lru_cache_remove(LruCache* cache, int index) {
+    CacheEntry* entry = cache->entries[index];
+    cache->entries[index] = cache->entries[--cache->count];
+    cache->bytes -= entry->bytes;
+    if (entry->references > 0) {
+        entry->stale = true;
+        return;
     }
-    return NULL;
+    cache->free_value(entry->value);
+    free(entry->path);
+    free(entry);
 }
 
-void free_hash_table(HashTable* table) {
-    for (int i = 0; i < table->size; i++) {
-        if (table->entries[i].used) {
-            free(table->entries[i].label);
-            free(table->entries[i].point.label);
+// Returns the cached value for the current version of path and holds it, or NULL on a miss
+void* lru_cache_acquire(LruCache* cache, const char* path, const struct stat* info, CacheEntry** handle) {
+    void* value = NULL;
+    *handle = NULL;
+    SDL_LockMutex(cache->lock);
+    for (int i = 0; i < cache->count; ++i) {
+        CacheEntry* entry = cache->entries[i];
+        if (strcmp(entry->path, path) != 0) continue;
+        if (entry->mtime == info->st_mtime && entry->file_size == info->st_size) {
+            entry->references++;
+            entry->last_used = ++cache->clock;
+            *handle = entry;
+            value = entry->value;
+        } else {
+            lru_cache_remove(cache, i); // The file changed
         }
+        break;
     }
-    free(table->entries);
-    free(table);
-}
-
-// --- Drawing Functions ---
-void set_draw_color(SDL_Renderer* renderer, SDL_Color color) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    if (value) cache->hits++;
+    else cache->misses++;
+    SDL_UnlockMutex(cache->lock);
+    return value;
 }
 
-void draw_filled_circle(SDL_Renderer* renderer, int cx, int cy, int radius, SDL_Color color) {
-    set_draw_color(renderer, color);
-    for (int y = -radius; y <= radius; y++) {
-        float x_squared = radius * radius - y * y;
-        if (x_squared < 0) x_squared = 0;
-        int x_span = sqrt(x_squared);
-        SDL_RenderDrawLine(renderer, cx - x_span, cy + y, cx + x_span, cy + y);
+// Adds a freshly loaded value, held by the caller, evicting least recently used entries
+// to stay within the budget. A value larger than the whole budget is handed back uncached.
+CacheEntry* lru_cache_insert(LruCache* cache, const char* path, const struct stat* info, void* value, size_t bytes) {
+    CacheEntry* entry = calloc(1, sizeof(CacheEntry));
+    entry->path = strdup(path);
+    entry->mtime = info->st_mtime;
+    entry->file_size = info->st_size;
+    entry->value = value;
+    entry->bytes = bytes;
+    entry->references = 1;
+    SDL_LockMutex(cache->lock);
+    for (int i = 0; i < cache->count; ++i) {
+        if (strcmp(cache->entries[i]->path, path) == 0) {
+            lru_cache_remove(cache, i); // Another worker loaded it concurrently; keep the newer copy
+            break;
+        }
     }
-}
-
-void draw_text(SDL_Renderer* renderer, TTF_Font* font, const char* text, int x, int y, SDL_Color color) {
-    if (!font || !text || text[0] == '\0') return;
-    SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, color);
-    if (!textSurface) {
-        fprintf(stderr, "Unable to render text surface! TTF_Error: %s\n", TTF_GetError());
-        return;
+    while (cache->bytes + bytes > cache->budget) {
+        int oldest = -1;
+        for (int i = 0; i < cache->count; ++i) {
+            if (cache->entries[i]->references > 0) continue;
+            if (oldest < 0 || cache->entries[i]->last_used < cache->entries[oldest]->last_used) oldest = i;
+        }
+        if (oldest < 0) break; // Everything left is in use
+        lru_cache_remove(cache, oldest);
+        cache->evictions++;
     }
-    SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    if (textTexture) {
-        int textW, textH;
-        SDL_QueryTexture(textTexture, NULL, NULL, &textW, &textH);
-        SDL_Rect backgroundRect = {x, y, textW, textH};
-        set_draw_color(renderer, COLOR_WHITE_BG);
-        SDL_RenderFillRect(renderer, &backgroundRect);
-        SDL_Rect renderQuad = {x, y, textW, textH};
-        SDL_RenderCopy(renderer, textTexture, NULL, &renderQuad);
-        SDL_DestroyTexture(textTexture);
+    if (cache->bytes + bytes > cache->budget) {
+        entry->stale = true; // Doesn't fit; freed when the caller releases it
+    } else {
+        if (cache->count == cache->capacity) {
+            cache->capacity = cache->capacity ? cache->capacity * 2 : 16;
+            cache->entries = realloc(cache->entries, cache->capacity * sizeof(CacheEntry*));
+        }
+        cache->entries[cache->count++] = entry;
+        cache->bytes += bytes;
+        entry->last_used = ++cache->clock;
     }
-    SDL_FreeSurface(textSurface);
+    SDL_UnlockMutex(cache->lock);
+    return entry;
 }
 
-void draw_point_with_label(SDL_Renderer* renderer, Point point, int radius, SDL_Color color, TTF_Font* font) {
-    draw_filled_circle(renderer, point.x, point.y, radius, color);
-    if (point.label) {
-        int label_x_offset = radius + 5;
-        int label_y_offset = -radius;
-        draw_text(renderer, font, point.label, point.x + label_x_offset, point.y + label_y_offset, color);
+void lru_cache_release(LruCache* cache, CacheEntry* entry) {
+    if (!entry) return;
+    SDL_LockMutex(cache->lock);
+    bool free_now = --entry->references == 0 && entry->stale;
+    SDL_UnlockMutex(cache->lock);
+    if (free_now) {
+        cache->free_value(entry->value);
+        free(entry->path);
+        free(entry);
     }
 }
 
-void draw_thick_line(SDL_Renderer* renderer, Line line, int thickness, SDL_Color color, HashTable* point_table) {
-    Point* p1 = hash_table_get(point_table, line.label1);
-    Point* p2 = hash_table_get(point_table, line.label2);
-    if (!p1 || !p2) {
-        fprintf(stderr, "Warning: Line references undefined points: %s, %s\n", line.label1, line.label2);
-        return;
-    }
+// Appends "name: entries, MB, hits, misses, evictions" to text
+void lru_cache_describe(LruCache* cache, char* text, size_t text_size) {
+    SDL_LockMutex(cache->lock);
+    size_t length = strlen(text);
+    snprintf(text + length, text_size - length, "%s%s: %d entries, %.1f/%.1f MB, %llu hits, %llu misses, %llu evictions",
+             length ? "; " : "", cache->name, cache->count, cache->bytes / 1048576.0, cache->budget / 1048576.0,
+             (unsigned long long)cache->hits, (unsigned long long)cache->misses, (unsigned long long)cache->evictions);
+    SDL_UnlockMutex(cache->lock);
+}
 
-    // Removed repeated printf to avoid console flooding
-    // Use single line rendering for testing visibility
-    set_draw_color(renderer, color);
-    int x1 = p1->x, y1 = p1->y;
-    int x2 = p2->x, y2 = p2->y;
-    SDL_RenderDrawLine(renderer, x1, y1, x2, y2); // Simplified to single line
+void lru_cache_free(LruCache* cache) {
+    while (cache->count > 0) lru_cache_remove(cache, cache->count - 1);
+    free(cache->entries);
+    SDL_DestroyMutex(cache->lock);
+}
 
-    /* Original thick line code (commented out for testing)
-    float dx = x2 - x1;
-    float dy = y2 - y1;
-    float length = sqrt(dx*dx + dy*dy);
+void cache_free_surface(void* value) {
+    SDL_FreeSurface(value);
+}
 
-    if (length == 0) {
-        for (int i = -thickness/2; i <= thickness/2; ++i) {
-            for (int j = -thickness/2; j <= thickness/2; ++j) {
-                SDL_RenderDrawPoint(renderer, x1 + i, y1 + j);
-            }
-        }
-        return;
-    }
+void cache_free_drawing(void* value) {
+    free_drawing(value);
+    free(value);
+}
 
-    float nx = -dy / length;
-    float ny = dx / length;
-    for (int i = -thickness / 2; i <= thickness / 2; ++i) {
-        SDL_RenderDrawLine(renderer, x1 + (int)(i * nx), y1 + (int)(i * ny), x2 + (int)(i * nx), y2 + (int)(i * ny));
+// Approximate heap footprint of a parsed drawing, for the cache budget
+size_t drawing_memory_size(const Drawing* drawing) {
+    size_t bytes = sizeof(Drawing) + (size_t)drawing->point_capacity * (sizeof(Point) + 1) +
+                   (size_t)drawing->line_capacity * sizeof(Line) + (size_t)drawing->point_table->size * sizeof(HashEntry) +
+                   (size_t)drawing->time_count * sizeof(TimeEntry) + (size_t)drawing->stats.diagnostic_count * sizeof(Diagnostic) +
+                   (size_t)drawing->seen_lines.size * sizeof(uint64_t);
+    for (int i = 0; i < drawing->point_count; ++i) bytes += strlen(drawing->points[i].label) + 1;
+    for (int i = 0; i < drawing->line_count; ++i) {
+        bytes += strlen(drawing->lines[i].label1) + strlen(drawing->lines[i].label2) + 2;
     }
-    */
+    for (int i = 0; i < drawing->column_count; ++i) {
+        const AttributeColumn* column = &drawing->columns[i];
+        bytes += (size_t)drawing->point_capacity * (column->type == ATTRIBUTE_NUMBER ? sizeof(double) : sizeof(int));
+        if (column->dictionary) bytes += (size_t)column->dictionary->size * sizeof(HashEntry) + column->value_count * 16;
+    }
+    return bytes;
 }
 
-// --- Parse Function ---
-bool parse_drawing_file(const char* filepath, Point* points, int* point_count, Line* lines, int* line_count, int max_elements, HashTable* point_table) {
-    FILE* file = fopen(filepath, "r");
-    if (!file) {
-        fprintf(stderr, "Warning: Could not open drawing file %s. Proceeding without drawing data.\n", filepath);
-        return false;
+// Returns the decoded ARGB8888 image for path, from the cache or by decoding and caching it.
+// The caller releases *entry when done.
+SDL_Surface* cached_image(LruCache* cache, const char* path, CacheEntry** entry, bool* hit) {
+    struct stat info;
+    *entry = NULL;
+    *hit = false;
+    if (stat(path, &info) != 0) {
+        SDL_SetError("%s", strerror(errno));
+        return NULL;
+    }
+    SDL_Surface* image = lru_cache_acquire(cache, path, &info, entry);
+    if (image) {
+        *hit = true;
+        return image;
     }
+    SDL_Surface* loaded = IMG_Load(path);
+    if (!loaded) return NULL;
+    image = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+    if (!image) return NULL;
+    *entry = lru_cache_insert(cache, path, &info, image, sizeof(SDL_Surface) + (size_t)image->pitch * image->h);
+    return image;
+}
 
-    char line_buffer[512];
-    *point_count = 0;
-    *line_count = 0;
+// Returns the parsed drawing for path, from the cache or by parsing it. Drawings that fail
+// to load aren't cached; then *entry is NULL and the caller owns the result.
+Drawing* cached_drawing(LruCache* cache, const char* path, const LoadOptions* options, CacheEntry** entry, bool* hit) {
+    struct stat info;
+    *entry = NULL;
+    *hit = false;
+    bool cacheable = stat(path, &info) == 0;
+    Drawing* drawing = cacheable ? lru_cache_acquire(cache, path, &info, entry) : NULL;
+    if (drawing) {
+        *hit = true;
+        return drawing;
+    }
+    drawing = malloc(sizeof(Drawing));
+    drawing_init(drawing);
+    if (parse_drawing_file(path, drawing, options) && cacheable) {
+        *entry = lru_cache_insert(cache, path, &info, drawing, drawing_memory_size(drawing));
+    }
+    return drawing;
+}
 
-    // First pass: collect points
-    while (fgets(line_buffer, sizeof(line_buffer), file)) {
-        line_buffer[strcspn(line_buffer, "\n")] = 0;
-        if (line_buffer[0] == '#' || line_buffer[0] == '\0') continue;
+// --- Server Mode ---
+volatile sig_atomic_t server_stopping = 0;
 
-        char* point_call_start = strstr(line_buffer, "point(");
-        if (point_call_start) {
-            char* param_start = point_call_start + strlen("point(");
-            char* param_end = strstr(param_start, ")");
-            if (!param_end) continue;
+void server_signal_handler(int signal_number) {
+    (void)signal_number;
+    server_stopping = 1;
+}
 
-            *param_end = '\0';
-            char* current_pos = param_start;
-            char* first_comma = strchr(current_pos, ',');
-            if (!first_comma) continue;
+void job_queue_init(JobQueue* queue) {
+    memset(queue, 0, sizeof(JobQueue));
+    queue->fds = malloc(SERVER_QUEUE_SIZE * sizeof(int));
+    queue->lock = SDL_CreateMutex();
+    queue->changed = SDL_CreateCond();
+}
 
-            *first_comma = '\0';
-            int x;
-            if (sscanf(current_pos, "%d", &x) != 1) continue;
-            current_pos = first_comma + 1;
+void job_queue_free(JobQueue* queue) {
+    free(queue->fds);
+    SDL_DestroyCond(queue->changed);
+    SDL_DestroyMutex(queue->lock);
+}
 
-            char* second_comma = strchr(current_pos, ',');
-            if (!second_comma) continue;
+// Blocks while the queue is full
+void job_queue_push(JobQueue* queue, int fd) {
+    SDL_LockMutex(queue->lock);
+    while (queue->count == SERVER_QUEUE_SIZE) {
+        SDL_CondWait(queue->changed, queue->lock);
+    }
+    queue->fds[(queue->head + queue->count++) % SERVER_QUEUE_SIZE] = fd;
+    SDL_CondBroadcast(queue->changed);
+    SDL_UnlockMutex(queue->lock);
+}
 
-            *second_comma = '\0';
-            int y;
-            if (sscanf(current_pos, "%d", &y) != 1) continue;
-            current_pos = second_comma + 1;
+// Returns the next connection, or -1 once the queue is stopped and empty
+int job_queue_pop(JobQueue* queue) {
+    SDL_LockMutex(queue->lock);
+    while (queue->count == 0 && !queue->stop) {
+        SDL_CondWait(queue->changed, queue->lock);
+    }
+    int fd = -1;
+    if (queue->count > 0) {
+        fd = queue->fds[queue->head];
+        queue->head = (queue->head + 1) % SERVER_QUEUE_SIZE;
+        queue->count--;
+        SDL_CondBroadcast(queue->changed);
+    }
+    SDL_UnlockMutex(queue->lock);
+    return fd;
+}
 
-            char* label_content = current_pos;
-            if (*label_content == '\0') {
-                fprintf(stderr, "Error: Point missing required label: %s\n", line_buffer);
-                continue;
-            }
+void job_queue_stop(JobQueue* queue) {
+    SDL_LockMutex(queue->lock);
+    queue->stop = true;
+    SDL_CondBroadcast(queue->changed);
+    SDL_UnlockMutex(queue->lock);
+}
 
-            char* label_end = label_content + strlen(label_content) - 1;
-            while (label_end > label_content && isspace(*label_end)) {
-                *label_end = '\0';
-                label_end--;
-            }
+void render_job_free(RenderJob* job) {
+    free(job->image_path);
+    free(job->drawing_path);
+    free(job->filter);
+    free(job->output_path);
+    free(job->format);
+    free(job->inline_drawing);
+    memset(job, 0, sizeof(RenderJob));
+}
 
-            if (*point_count < max_elements) {
-                points[*point_count].x = x;
-                points[*point_count].y = y;
-                points[*point_count].label = strdup(label_content);
-                hash_table_insert(point_table, label_content, points[*point_count]);
-                (*point_count)++;
-                printf("Parsed Point: (%d, %d, %s)\n", x, y, label_content);
-            } else {
-                fprintf(stderr, "Warning: Max points (%d) reached. Skipping point: %s\n", max_elements, line_buffer);
+// Reads the key=value header up to an empty line, then any inline drawing. Returns false
+// with error set if the request is malformed.
+bool read_render_job(FILE* in, RenderJob* job, char* error, size_t error_size) {
+    memset(job, 0, sizeof(RenderJob));
+    char line[MAX_RECORD_LENGTH];
+    long inline_length = 0;
+    for (;;) {
+        if (!fgets(line, sizeof(line), in)) {
+            snprintf(error, error_size, "request ended before the empty line");
+            return false;
+        }
+        if (!strchr(line, '\n') && !feof(in)) {
+            snprintf(error, error_size, "header line too long");
+            return false;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') break;
+        char* equals = strchr(line, '=');
+        if (!equals) {
+            snprintf(error, error_size, "expected key=value: %s", line);
+            return false;
+        }
+        *equals = '\0';
+        const char* value = equals + 1;
+        char** field = NULL;
+        if (strcmp(line, "image") == 0) field = &job->image_path;
+        else if (strcmp(line, "drawing") == 0) field = &job->drawing_path;
+        else if (strcmp(line, "filter") == 0) field = &job->filter;
+        else if (strcmp(line, "output") == 0) field = &job->output_path;
+        else if (strcmp(line, "format") == 0) field = &job->format;
+        if (field) {
+            free(*field);
+            *field = strdup(value);
+        } else if (strcmp(line, "command") == 0 && strcmp(value, "stats") == 0) {
+            job->stats_only = true;
+        } else if (strcmp(line, "inline") == 0) {
+            inline_length = atol(value);
+            if (inline_length < 0 || inline_length > SERVER_MAX_INLINE_DRAWING) {
+                snprintf(error, error_size, "inline drawing size out of range: %s", value);
+                return false;
             }
+        } else {
+            snprintf(error, error_size, "unknown key: %s", line);
+            return false;
         }
     }
+    if (job->stats_only) return true;
+    if (!job->image_path || !job->output_path) {
+        snprintf(error, error_size, "image= and output= are required");
+        return false;
+    }
+    if (!job->format) {
+        const char* extension = strrchr(job->output_path, '.');
+        job->format = strdup(extension ? extension + 1 : "png");
+    }
+    if (strcmp(job->format, "png") != 0 && strcmp(job->format, "bmp") != 0 && strcmp(job->format, "ppm") != 0 &&
+        strcmp(job->format, "svg") != 0) {
+        snprintf(error, error_size, "unknown output format: %s", job->format);
+        return false;
+    }
+    if (inline_length > 0) {
+        job->inline_drawing = malloc(inline_length);
+        job->inline_length = fread(job->inline_drawing, 1, inline_length, in);
+        if (job->inline_length != (size_t)inline_length) {
+            snprintf(error, error_size, "inline drawing truncated after %zu of %ld bytes", job->inline_length, inline_length);
+            return false;
+        }
+    }
+    return true;
+}
 
-    // Rewind file for second pass: collect lines
-    rewind(file);
-    while (fgets(line_buffer, sizeof(line_buffer), file)) {
-        line_buffer[strcspn(line_buffer, "\n")] = 0;
-        if (line_buffer[0] == '#' || line_buffer[0] == '\0') continue;
-
-        char* line_call_start = strstr(line_buffer, "line(");
-        if (line_call_start) {
-            char* param_start = line_call_start + strlen("line(");
-            char* param_end = strstr(param_start, ")");
-            if (!param_end) continue;
-
-            *param_end = '\0';
-            char* current_pos = param_start;
-            char* comma = strchr(current_pos, ',');
-            if (!comma) continue;
+// Renders one job and describes the outcome in message. Returns false on failure.
+bool render_job(RenderWorker* worker, const RenderJob* job, char* message, size_t message_size) {
+    CacheEntry* image_entry;
+    bool image_hit;
+    SDL_Surface* image = cached_image(worker->images, job->image_path, &image_entry, &image_hit);
+    if (!image) {
+        snprintf(message, message_size, "failed to load image %s: %s", job->image_path, IMG_GetError());
+        return false;
+    }
+    Options options;
+    memset(&options, 0, sizeof(Options));
+    options.load.duplicate_policy = DUPLICATE_LAST_WINS;
+    options.filter = job->filter;
 
-            *comma = '\0';
-            char* label1 = current_pos;
-            while (isspace(*label1)) label1++;
-            char* label1_end = label1 + strlen(label1) - 1;
-            while (label1_end > label1 && isspace(*label1_end)) {
-                *label1_end = '\0';
-                label1_end--;
-            }
+    // A .vd file on its own comes from the drawing cache and is shared read-only: the job
+    // works on a shallow copy with its own visibility flags. Inline text is parsed per job.
+    CacheEntry* drawing_entry = NULL;
+    bool drawing_hit = false;
+    Drawing* shared = NULL;
+    Drawing drawing;
+    bool ok = true;
+    if (job->drawing_path && !job->inline_drawing) {
+        shared = cached_drawing(worker->drawings, job->drawing_path, &options.load, &drawing_entry, &drawing_hit);
+        ok = shared->stats.errors == 0;
+        drawing = *shared;
+        drawing.point_flags = malloc(drawing.point_capacity + 1);
+        memcpy(drawing.point_flags, shared->point_flags, drawing.point_count);
+    } else {
+        drawing_init(&drawing);
+        options.drawing_file_path = job->drawing_path;
+        ok = load_drawing(&drawing, &options);
+        if (job->inline_drawing) ok &= parse_drawing_text("inline", job->inline_drawing, job->inline_length, &drawing, &options.load);
+    }
+    FilterNode* filter;
+    bool filter_ok = apply_filter_option(&drawing, &options, &filter);
 
-            current_pos = comma + 1;
-            char* label2 = current_pos;
-            while (isspace(*label2)) label2++;
-            char* label2_end = label2 + strlen(label2) - 1;
-            while (label2_end > label2 && isspace(*label2_end)) {
-                *label2_end = '\0';
-                label2_end--;
+    bool written;
+    if (strcmp(job->format, "svg") == 0) {
+        written = export_svg(job->output_path, &drawing, job->image_path, SVG_IMAGE_LINK, image->w, image->h);
+    } else {
+        // Draw onto a copy so the cached image stays clean
+        SDL_Surface* canvas = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_Renderer* renderer = canvas ? SDL_CreateSoftwareRenderer(canvas) : NULL;
+        written = renderer != NULL;
+        if (renderer) {
+            Viewport identity = {0, 0, 1, {0, 0, canvas->w, canvas->h}};
+            for (int i = 0; i < drawing.line_count; ++i) {
+                if (!line_is_visible(&drawing, drawing.lines[i])) continue;
+                draw_thick_line(renderer, drawing.lines[i], DRAW_LINE_THICKNESS, COLOR_RED, drawing.point_table, &identity);
             }
-
-            if (*label1 == '\0' || *label2 == '\0') {
-                fprintf(stderr, "Error: Line missing valid labels: %s\n", line_buffer);
-                continue;
+            for (int i = 0; i < drawing.point_count; ++i) {
+                if (drawing.point_flags[i]) continue;
+                draw_point_with_label(renderer, drawing.points[i], DRAW_POINT_RADIUS, COLOR_BLACK, worker->font);
             }
-
-            if (*line_count < max_elements) {
-                lines[*line_count].label1 = strdup(label1);
-                lines[*line_count].label2 = strdup(label2);
-                if (!hash_table_get(point_table, label1) || !hash_table_get(point_table, label2)) {
-                    fprintf(stderr, "Warning: Line references undefined points: %s, %s\n", label1, label2);
-                } else {
-                    (*line_count)++;
-                    printf("Parsed Line: %s to %s\n", label1, label2);
-                }
+            SDL_RenderFlush(renderer);
+            SDL_DestroyRenderer(renderer);
+            if (strcmp(job->format, "png") == 0) {
+                written = IMG_SavePNG(canvas, job->output_path) == 0;
+            } else if (strcmp(job->format, "bmp") == 0) {
+                written = SDL_SaveBMP(canvas, job->output_path) == 0;
             } else {
-                fprintf(stderr, "Warning: Max lines (%d) reached. Skipping line: %s\n", max_elements, line_buffer);
+                BufferedWriter writer;
+                written = writer_open(&writer, job->output_path);
+                if (written) {
+                    unsigned char* scratch = malloc((size_t)canvas->w * canvas->h * 3);
+                    write_frame(&writer, FRAME_FORMAT_PPM, canvas, scratch);
+                    free(scratch);
+                    written = writer_close(&writer);
+                }
             }
         }
+        if (canvas) SDL_FreeSurface(canvas);
     }
-
-    fclose(file);
-    printf("Finished parsing. Loaded %d points and %d lines.\n", *point_count, *line_count);
-    return true;
+    const LoadStats* stats = &drawing.stats;
+    if (!written) {
+        snprintf(message, message_size, "failed to write %s: %s", job->output_path, SDL_GetError());
+    } else {
+        snprintf(message, message_size, "%s %dx%d, %d points, %d lines, %d errors, %d warnings, image %s, drawing %s%s",
+                 job->output_path, image->w, image->h, drawing.point_count, drawing.line_count, stats->errors, stats->warnings,
+                 image_hit ? "cached" : "loaded", !shared ? "parsed" : drawing_hit ? "cached" : "loaded",
+                 filter_ok ? "" : ", invalid filter (rendered unfiltered)");
+    }
+    free_filter(filter);
+    if (shared) {
+        free(drawing.point_flags);
+        if (drawing_entry) {
+            lru_cache_release(worker->drawings, drawing_entry);
+        } else {
+            cache_free_drawing(shared); // Failed to load, so it wasn't cached
+        }
+    } else {
+        free_drawing(&drawing);
+    }
+    lru_cache_release(worker->images, image_entry);
+    return ok && filter_ok && written;
 }
 
-// --- Free Function ---
-void free_loaded_drawing_data(Point* points, int point_count, Line* lines, int line_count, HashTable* point_table) {
-    for (int i = 0; i < point_count; ++i) {
-        points[i].label = NULL; // Freed via hash table
+// Serves one connection: reads the request, renders it and answers with a single
+// "ok ..." or "error ..." line
+void handle_render_connection(RenderWorker* worker, int fd) {
+    struct timeval timeout = {SERVER_READ_TIMEOUT, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    FILE* in = fdopen(fd, "rb");
+    if (!in) {
+        close(fd);
+        return;
     }
-    for (int i = 0; i < line_count; ++i) {
-        free(lines[i].label1);
-        free(lines[i].label2);
+    Uint64 start = SDL_GetPerformanceCounter();
+    RenderJob job;
+    char message[MAX_RECORD_LENGTH];
+    bool ok = read_render_job(in, &job, message, sizeof(message));
+    if (ok && job.stats_only) {
+        message[0] = '\0';
+        lru_cache_describe(worker->images, message, sizeof(message));
+        lru_cache_describe(worker->drawings, message, sizeof(message));
+    } else if (ok) {
+        ok = render_job(worker, &job, message, sizeof(message));
     }
-    free_hash_table(point_table);
+    double milliseconds = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    dprintf(fd, "%s %s (%.1f ms)\n", ok ? "ok" : "error", message, milliseconds);
+    fprintf(stderr, "[worker %d] %s %s (%.1f ms)\n", worker->index, ok ? "ok" : "error", message, milliseconds);
+    render_job_free(&job);
+    fclose(in);
 }
 
-// --- Save Screenshot Function ---
-bool save_screenshot(SDL_Renderer* renderer, int width, int height, const char* filename) {
-    SDL_Surface* surface = SDL_CreateRGBSurface(0, width, height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-    if (!surface) {
-        fprintf(stderr, "Failed to create surface for screenshot: %s\n", SDL_GetError());
-        return false;
+int render_worker_thread(void* data) {
+    RenderWorker* worker = data;
+    int fd;
+    while ((fd = job_queue_pop(worker->queue)) >= 0) {
+        handle_render_connection(worker, fd);
     }
-    if (SDL_RenderReadPixels(renderer, NULL, surface->format->format, surface->pixels, surface->pitch) != 0) {
-        fprintf(stderr, "Failed to read pixels from renderer for screenshot: %s\n", SDL_GetError());
-        SDL_FreeSurface(surface);
-        return false;
+    return 0;
+}
+
+// Listens on a UNIX domain socket and renders jobs on a pool of workers, so SDL_ttf, the
+// fonts and recently decoded images stay loaded between jobs. A request is a header of
+// key=value lines ended by an empty line:
+//   image=PATH      base image (required)
+//   output=PATH     where to write the result (required)
+//   format=FORMAT   png, bmp, ppm or svg; defaults to the output's extension
+//   drawing=PATH    .vd file, may be gzip-compressed
+//   filter=EXPR     attribute filter, as with --filter
+//   inline=N        N bytes of .vd text follow the empty line
+//   command=stats   instead of rendering, report the image and drawing cache metrics
+// The server answers with one line starting with "ok" or "error" and closes the connection.
+// Runs until SIGINT or SIGTERM. Returns the process exit code.
+int run_server(const Options* options) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(options->serve_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", options->serve_path);
+        return 1;
     }
-    if (IMG_SavePNG(surface, filename) != 0) {
-        fprintf(stderr, "Failed to save surface as PNG: %s\n", IMG_GetError());
-        SDL_FreeSurface(surface);
-        return false;
+    strcpy(address.sun_path, options->serve_path);
+    struct stat info;
+    if (lstat(options->serve_path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            fprintf(stderr, "Refusing to serve on %s: the file exists and is not a socket\n", options->serve_path);
+            return 1;
+        }
+        unlink(options->serve_path); // A stale socket from an earlier run
     }
-    SDL_FreeSurface(surface);
-    printf("Screenshot saved successfully to %s.\n", filename);
-    return true;
+    if (TTF_Init() == -1) {
+        fprintf(stderr, "SDL_ttf could not initialize! TTF_Error: %s\n", TTF_GetError());
+        return 1;
+    }
+    // Load the format libraries once, before any worker can reach SDL_image's lazy,
+    // non-thread-safe initialization in IMG_Load or IMG_SavePNG
+    int img_flags = IMG_INIT_PNG | IMG_INIT_JPG;
+    if (!(IMG_Init(img_flags) & img_flags)) {
+        fprintf(stderr, "SDL_image could not initialize! IMG_Error: %s\n", IMG_GetError());
+        TTF_Quit();
+        return 1;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, SERVER_QUEUE_SIZE) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", options->serve_path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        IMG_Quit();
+        TTF_Quit();
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_signal_handler; // No SA_RESTART, so accept() returns on a signal
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN); // Clients that hang up early shouldn't stop the server
+
+    JobQueue queue;
+    job_queue_init(&queue);
+    LruCache images, drawings;
+    lru_cache_init(&images, "images", (size_t)options->image_cache_mb << 20, cache_free_surface);
+    lru_cache_init(&drawings, "drawings", (size_t)options->drawing_cache_mb << 20, cache_free_drawing);
+    int worker_count = options->server_workers > 0 ? options->server_workers : SDL_GetCPUCount();
+    if (worker_count > MAX_WORKERS) worker_count = MAX_WORKERS;
+    RenderWorker* workers = calloc(worker_count, sizeof(RenderWorker));
+    int started = 0;
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i].queue = &queue;
+        workers[i].images = &images;
+        workers[i].drawings = &drawings;
+        workers[i].index = i;
+        workers[i].font = TTF_OpenFont(FONT_PATH, FONT_SIZE); // Opened here, one thread at a time
+        if (!workers[i].font && i == 0) fprintf(stderr, "Failed to load font %s! TTF_Error: %s\n", FONT_PATH, TTF_GetError());
+        workers[i].thread = SDL_CreateThread(render_worker_thread, "render", &workers[i]);
+        if (workers[i].thread) started++;
+    }
+    // Without a worker, accepted connections would fill the queue and block the accept loop
+    if (started == 0) {
+        fprintf(stderr, "Failed to start render workers: %s\n", SDL_GetError());
+    } else {
+        fprintf(stderr, "Serving on %s with %d workers\n", options->serve_path, started);
+    }
+
+    while (started > 0 && !server_stopping) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            break;
+        }
+        job_queue_push(&queue, fd);
+    }
+
+    close(listen_fd);
+    unlink(options->serve_path);
+    job_queue_stop(&queue); // Workers finish the connections already accepted
+    for (int i = 0; i < worker_count; ++i) {
+        if (workers[i].thread) SDL_WaitThread(workers[i].thread, NULL);
+        if (workers[i].font) TTF_CloseFont(workers[i].font);
+    }
+    free(workers);
+    char summary[MAX_RECORD_LENGTH] = "";
+    lru_cache_describe(&images, summary, sizeof(summary));
+    lru_cache_describe(&drawings, summary, sizeof(summary));
+    fprintf(stderr, "%s\n", summary);
+    lru_cache_free(&images);
+    lru_cache_free(&drawings);
+    job_queue_free(&queue);
+    IMG_Quit();
+    TTF_Quit();
+    fprintf(stderr, "Server stopped\n");
+    return started > 0 ? 0 : 1;
 }
 
 // --- Main Function ---
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <image_file_path> [drawing_file.vd]\n", argv[0]);
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (options.check) {
+        return run_check(&options);
+    }
+    if (options.stats) {
+        return run_stats(&options);
+    }
+    if (options.svg_path) {
+        options.load.verbose = false;
+        return run_svg_export(&options);
+    }
+    if (options.frames_path) {
+        options.load.verbose = false;
+        return run_frames(&options);
+    }
+    if (options.serve_path) {
+        return run_server(&options);
+    }
+    const char* image_path = options.image_path;
+
+    // The viewer opens despite bad records or a missing drawing; only duplicates under
+    // --duplicates=error and a bad --filter stop it before a window is created
+    Drawing drawing;
+    drawing_init(&drawing);
+    load_drawing(&drawing, &options);
+    print_diagnostics(stderr, &drawing);
+    bool rejected = options.load.duplicate_policy == DUPLICATE_ERROR && drawing.stats.duplicate_labels > 0;
+    FilterNode* filter = NULL;
+    if (rejected || !apply_filter_option(&drawing, &options, &filter)) {
+        free_drawing(&drawing);
         return 1;
     }
-    const char* image_path = argv[1];
-    const char* drawing_file_path = argc > 2 ? argv[2] : NULL;
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         fprintf(stderr, "SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
     int img_flags = IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_WEBP;
     if (!(IMG_Init(img_flags) & img_flags)) {
         fprintf(stderr, "SDL_image could not initialize! IMG_Error: %s\n", IMG_GetError());
         SDL_Quit();
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
     if (TTF_Init() == -1) {
         fprintf(stderr, "SDL_ttf could not initialize! TTF_Error: %s\n", TTF_GetError());
         IMG_Quit();
         SDL_Quit();
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
 
@@ -379,6 +4989,8 @@ int main(int argc, char* argv[]) {
         TTF_Quit();
         IMG_Quit();
         SDL_Quit();
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
     SCREEN_WIDTH = loaded_surface->w;
@@ -391,10 +5003,12 @@ int main(int argc, char* argv[]) {
         TTF_Quit();
         IMG_Quit();
         SDL_Quit();
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
 
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
     if (!renderer) {
         fprintf(stderr, "Renderer could not be created! SDL Error: %s\n", SDL_GetError());
         SDL_DestroyWindow(window);
@@ -402,6 +5016,8 @@ int main(int argc, char* argv[]) {
         TTF_Quit();
         IMG_Quit();
         SDL_Quit();
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
 
@@ -414,25 +5030,54 @@ int main(int argc, char* argv[]) {
         TTF_Quit();
         IMG_Quit();
         SDL_Quit();
+        free_filter(filter);
+        free_drawing(&drawing);
         return 1;
     }
-    SDL_FreeSurface(loaded_surface);
+    Comparison comparison = {0};
+    bool has_comparison = options.compare_path && comparison_init(&comparison, renderer, loaded_surface, options.compare_path);
+    if (!has_comparison) comparison_free(&comparison);
+    // Keep a CPU copy in a known format for adjustments
+    SDL_Surface* image_surface = loaded_surface;
+    if (loaded_surface->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        image_surface = SDL_ConvertSurfaceFormat(loaded_surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(loaded_surface);
+        if (!image_surface) fprintf(stderr, "Failed to convert image %s! SDL Error: %s\n", image_path, SDL_GetError());
+    }
+    ImageAdjustment adjustment = {1, 1, 1};
+    Hud hud = {true};
+    Histogram histogram;
+    histogram_init(&histogram, image_surface);
+    EdgeMap edge_map;
+    edge_map_init(&edge_map, image_surface);
+    ImageAdjuster adjuster, compare_adjuster; // The comparison image gets the same adjustments
+    image_adjuster_init(&adjuster, image_surface);
+    image_adjuster_init(&compare_adjuster, comparison.surface);
 
-    const char* font_path = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
-    TTF_Font* gFont = TTF_OpenFont(font_path, FONT_SIZE);
+    TTF_Font* gFont = TTF_OpenFont(FONT_PATH, FONT_SIZE);
     if (!gFont) {
-        fprintf(stderr, "Failed to load font %s! TTF_Error: %s\n", font_path, TTF_GetError());
+        fprintf(stderr, "Failed to load font %s! TTF_Error: %s\n", FONT_PATH, TTF_GetError());
     }
 
-    Point loaded_points[MAX_DRAW_ELEMENTS];
-    int loaded_point_count = 0;
-    Line loaded_lines[MAX_DRAW_ELEMENTS];
-    int loaded_line_count = 0;
-    HashTable* point_table = create_hash_table();
-
-    if (drawing_file_path) {
-        parse_drawing_file(drawing_file_path, loaded_points, &loaded_point_count, loaded_lines, &loaded_line_count, MAX_DRAW_ELEMENTS, point_table);
-    }
+    TimeScrubber scrubber = {0};
+    bool filter_enabled = filter != NULL;
+    Heatmap heatmap;
+    heatmap_init(&heatmap, SCREEN_WIDTH, SCREEN_HEIGHT, 2.0f);
+    bool heatmap_enabled = options.heatmap;
+    PointCloud cloud;
+    point_cloud_init(&cloud, SCREEN_WIDTH, SCREEN_HEIGHT);
+    bool cloud_enabled = false;
+    LineDensity line_density;
+    line_density_init(&line_density, SCREEN_WIDTH, SCREEN_HEIGHT);
+    bool line_density_enabled = false;
+    // Panes share the image texture, font, drawing and overlay textures; each has its own viewport
+    Viewport views[MAX_PANES] = {{0, 0, 1}, {0, 0, 1}};
+    int view_count = 1;
+    int active_view = 0; // Pane that keys apply to; follows the mouse
+    layout_views(views, view_count, SCREEN_WIDTH, SCREEN_HEIGHT);
+    Minimap minimap;
+    minimap_init(&minimap, SCREEN_WIDTH, SCREEN_HEIGHT);
+    bool minimap_enabled = true; // Shown while a view doesn't cover the whole image
 
     bool quit = false;
     SDL_Event e;
@@ -441,15 +5086,69 @@ int main(int argc, char* argv[]) {
         while (SDL_PollEvent(&e) != 0) {
             if (e.type == SDL_QUIT) {
                 quit = true;
+            } else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_LEAVE) {
+                hud.has_cursor = false;
             } else if (e.type == SDL_MOUSEMOTION) {
-                int mouseX, mouseY;
-                SDL_GetMouseState(&mouseX, &mouseY);
+                int index = viewport_at(views, view_count, e.motion.x, e.motion.y);
+                if (index >= 0 && !(e.motion.state & SDL_BUTTON_MMASK)) active_view = index; // Keep panning the grabbed pane
+                Viewport* view = &views[active_view];
+                if (e.motion.state & SDL_BUTTON_MMASK) { // Middle-drag pans
+                    view->x -= e.motion.xrel / view->zoom;
+                    view->y -= e.motion.yrel / view->zoom;
+                }
+                double imageX, imageY;
+                viewport_to_image(view, e.motion.x - view->pane.x, e.motion.y - view->pane.y, &imageX, &imageY);
+                hud.cursor_x = (int)floor(imageX);
+                hud.cursor_y = (int)floor(imageY);
+                hud.has_cursor = index >= 0;
+                if ((e.motion.state & SDL_BUTTON_LMASK) && comparison.mode == COMPARE_SWIPE) comparison.swipe_x = imageX; // Drag the divider
                 char title[100];
-                snprintf(title, 100, "Image Viewer - Cursor: (%d, %d)", mouseX, mouseY);
+                snprintf(title, 100, "Image Viewer - Cursor: (%d, %d) Zoom: %.2fx", (int)floor(imageX), (int)floor(imageY), view->zoom);
                 SDL_SetWindowTitle(window, title);
+            } else if (e.type == SDL_MOUSEWHEEL && e.wheel.y != 0) { // Zoom around the cursor; horizontal scrolling is ignored
+                int mouseX, mouseY;
+                SDL_GetMouseState(&mouseX, &mouseY);
+                int index = viewport_at(views, view_count, mouseX, mouseY);
+                if (index >= 0) {
+                    Viewport* view = &views[index];
+                    viewport_zoom_at(view, e.wheel.y > 0 ? 1.25 : 0.8, mouseX - view->pane.x, mouseY - view->pane.y);
+                }
             } else if (e.type == SDL_MOUSEBUTTONDOWN) {
-                if (e.button.button == SDL_BUTTON_LEFT) {
-                    printf("Clicked at: (%d, %d)\n", e.button.x, e.button.y);
+                int index = viewport_at(views, view_count, e.button.x, e.button.y);
+                if (index < 0) continue;
+                active_view = index;
+                Viewport* view = &views[index];
+                int localX = e.button.x - view->pane.x, localY = e.button.y - view->pane.y;
+                double imageX, imageY;
+                bool on_minimap = minimap_enabled && viewport_is_partial(view, SCREEN_WIDTH, SCREEN_HEIGHT) &&
+                                  minimap_hit(&minimap, view, localX, localY, &imageX, &imageY);
+                if (!on_minimap) viewport_to_image(view, localX, localY, &imageX, &imageY);
+                if (on_minimap && e.button.button == SDL_BUTTON_LEFT) { // Jump to the clicked spot
+                    viewport_center_on(view, imageX, imageY);
+                } else if (e.button.button == SDL_BUTTON_LEFT) {
+                    printf("Clicked at: (%d, %d)\n", (int)floor(imageX), (int)floor(imageY));
+                    if (comparison.mode == COMPARE_SWIPE) {
+                        comparison.swipe_x = imageX;
+                    } else if (imageX >= 0 && imageY >= 0 && imageX < SCREEN_WIDTH && imageY < SCREEN_HEIGHT) {
+                        // Left-click places a point, snapped to the strongest nearby edge unless Alt is held
+                        int x = (int)floor(imageX), y = (int)floor(imageY);
+                        int radius = (int)ceil(SNAP_RADIUS / view->zoom);
+                        if (radius > 4 * SNAP_RADIUS) radius = 4 * SNAP_RADIUS;
+                        bool snapped = !(SDL_GetModState() & KMOD_ALT) && snap_to_edge(&edge_map, &x, &y, radius);
+                        int added = add_point(&drawing, x, y);
+                        printf("Added point: %s (%d, %d)%s\n", drawing.points[added].label, x, y, snapped ? " snapped to edge" : "");
+                        if (filter_enabled) apply_filter(&drawing, filter);
+                        if (scrubber.enabled) time_scrubber_update(&drawing, &scrubber);
+                    }
+                } else if (e.button.button == SDL_BUTTON_RIGHT && !on_minimap) { // Right-click deletes the nearest point
+                    int radius = (int)ceil((DRAW_POINT_RADIUS + 4) / view->zoom);
+                    int index = find_point_near(drawing.points, drawing.point_count, (int)lround(imageX), (int)lround(imageY), radius);
+                    if (index >= 0) {
+                        printf("Deleted point: %s\n", drawing.points[index].label);
+                        delete_point(&drawing, index);
+                        if (filter_enabled) apply_filter(&drawing, filter);
+                        if (scrubber.enabled) time_scrubber_update(&drawing, &scrubber);
+                    }
                 }
             } else if (e.type == SDL_KEYDOWN) {
                 switch (e.key.keysym.sym) {
@@ -464,37 +5163,211 @@ int main(int argc, char* argv[]) {
                     case SDLK_d: // Press 'd' to print debug info
                         debug_printed = false; // Allow reprinting
                         break;
+                    case SDLK_f: // Toggle the --filter expression
+                        if (filter) {
+                            filter_enabled = !filter_enabled;
+                            apply_filter(&drawing, filter_enabled ? filter : NULL);
+                        }
+                        break;
+                    case SDLK_p: // Cycle the point cloud mode: off, 1x1 pixels, 2x2 pixels
+                        if (!cloud_enabled) {
+                            cloud_enabled = true;
+                            cloud.point_size = 1;
+                        } else if (cloud.point_size == 1) {
+                            cloud.point_size = 2;
+                        } else {
+                            cloud_enabled = false;
+                        }
+                        break;
+                    case SDLK_l: // Toggle line density accumulation
+                        line_density_enabled = !line_density_enabled;
+                        break;
+                    case SDLK_h: // Toggle the density heatmap
+                        heatmap_enabled = !heatmap_enabled;
+                        break;
+                    case SDLK_LEFTBRACKET: // Narrow or widen the heatmap blur
+                    case SDLK_RIGHTBRACKET:
+                        heatmap.sigma += e.key.keysym.sym == SDLK_LEFTBRACKET ? -1.0f : 1.0f;
+                        if (heatmap.sigma < 0) heatmap.sigma = 0;
+                        if (heatmap.sigma > MAX_BLUR_RADIUS / 3) heatmap.sigma = MAX_BLUR_RADIUS / 3;
+                        break;
+                    case SDLK_c: // Cycle the comparison mode: off, swipe, flicker, difference
+                        if (has_comparison) {
+                            comparison.mode = (comparison.mode + 1) % COMPARE_MODE_COUNT;
+                        }
+                        break;
+                    case SDLK_1: // Brightness, contrast and gamma down/up in steps; '0' resets
+                    case SDLK_2:
+                    case SDLK_3:
+                    case SDLK_4:
+                    case SDLK_5:
+                    case SDLK_6:
+                    case SDLK_0: {
+                        SDL_Keycode key = e.key.keysym.sym;
+                        float step = key == SDLK_1 || key == SDLK_3 || key == SDLK_5 ? 1 / 1.25f : 1.25f;
+                        if (key == SDLK_1 || key == SDLK_2) adjustment.gain *= step;
+                        if (key == SDLK_3 || key == SDLK_4) adjustment.contrast *= step;
+                        if (key == SDLK_5 || key == SDLK_6) adjustment.gamma *= step;
+                        if (key == SDLK_0) adjustment = (ImageAdjustment){1, 1, 1};
+                        if (!adjustment_uses_color_mod(&adjustment)) {
+                            image_adjuster_request(&adjuster, renderer, &adjustment);
+                            image_adjuster_request(&compare_adjuster, renderer, &adjustment);
+                        }
+                        printf("Image adjustment: gain %.2f, contrast %.2f, gamma %.2f\n", adjustment.gain, adjustment.contrast, adjustment.gamma);
+                        break;
+                    }
+                    case SDLK_a: // Auto-contrast from the histogram
+                        if (histogram_auto_contrast(&histogram, &adjustment)) {
+                            image_adjuster_request(&adjuster, renderer, &adjustment);
+                            image_adjuster_request(&compare_adjuster, renderer, &adjustment);
+                            printf("Image adjustment: gain %.2f, contrast %.2f, gamma %.2f\n", adjustment.gain, adjustment.contrast, adjustment.gamma);
+                        }
+                        break;
+                    case SDLK_i: // Toggle the pixel readout and histogram
+                        hud.enabled = !hud.enabled;
+                        break;
+                    case SDLK_m: // Toggle the minimap
+                        minimap_enabled = !minimap_enabled;
+                        break;
+                    case SDLK_v: // Toggle a second pane side by side; it starts on the right half of the image
+                        view_count = view_count == 1 ? 2 : 1;
+                        layout_views(views, view_count, SCREEN_WIDTH, SCREEN_HEIGHT);
+                        if (view_count == 2) {
+                            views[1].zoom = views[0].zoom;
+                            views[1].x = views[0].x + views[0].pane.w / views[0].zoom;
+                            views[1].y = views[0].y;
+                        }
+                        if (active_view >= view_count) active_view = 0;
+                        break;
+                    case SDLK_HOME: // Reset the active view to the top-left corner at 1:1
+                        views[active_view].x = views[active_view].y = 0;
+                        views[active_view].zoom = 1;
+                        break;
+                    case SDLK_LEFT: // Pan by an eighth of the pane
+                    case SDLK_RIGHT:
+                        views[active_view].x += (e.key.keysym.sym == SDLK_LEFT ? -1 : 1) * views[active_view].pane.w / 8.0 / views[active_view].zoom;
+                        break;
+                    case SDLK_UP:
+                    case SDLK_DOWN:
+                        views[active_view].y += (e.key.keysym.sym == SDLK_UP ? -1 : 1) * views[active_view].pane.h / 8.0 / views[active_view].zoom;
+                        break;
+                    case SDLK_t: // Toggle the time-range scrubber
+                        time_scrubber_toggle(&drawing, &scrubber);
+                        break;
+                    case SDLK_COMMA: // Step the time range back or forward by a quarter of its width
+                    case SDLK_PERIOD:
+                        if (scrubber.enabled) {
+                            scrubber.start += (e.key.keysym.sym == SDLK_COMMA ? -0.25 : 0.25) * scrubber.width;
+                            time_scrubber_update(&drawing, &scrubber);
+                        }
+                        break;
+                    case SDLK_MINUS: // Halve or double the time range width
+                    case SDLK_EQUALS:
+                        if (scrubber.enabled) {
+                            scrubber.width *= e.key.keysym.sym == SDLK_MINUS ? 0.5 : 2.0;
+                            time_scrubber_update(&drawing, &scrubber);
+                        }
+                        break;
                 }
             }
         }
 
         set_draw_color(renderer, COLOR_WHITE_BG);
         SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, image_texture, NULL, NULL);
-
-        for (int i = 0; i < loaded_line_count; ++i) {
-            draw_thick_line(renderer, loaded_lines[i], DRAW_LINE_THICKNESS, COLOR_RED, point_table);
-            // Print debug info only once or when 'd' is pressed
-            if (!debug_printed) {
-                Point* p1 = hash_table_get(point_table, loaded_lines[i].label1);
-                Point* p2 = hash_table_get(point_table, loaded_lines[i].label2);
-                if (p1 && p2) {
-                    printf("Drawing line from %s (%d,%d) to %s (%d,%d)\n",
-                           loaded_lines[i].label1, p1->x, p1->y,
-                           loaded_lines[i].label2, p2->x, p2->y);
+        // Overlay textures are image-sized and rebuilt at most once per frame, then copied into every pane
+        if (heatmap_enabled) {
+            heatmap_update(renderer, &heatmap, &drawing);
+        } else {
+            if (line_density_enabled) line_density_update(renderer, &line_density, &drawing);
+            if (cloud_enabled) point_cloud_update(renderer, &cloud, &drawing);
+        }
+        // Gain alone is applied while copying; other adjustments show the workers' tiles as they
+        // finish. Both comparison images take the lookup table, or neither does.
+        SDL_Texture* base_texture = image_texture;
+        SDL_Texture* second_texture = comparison.texture;
+        float gain = adjustment.gain;
+        if (!adjustment_uses_color_mod(&adjustment) && adjuster.texture && (!has_comparison || compare_adjuster.texture)) {
+            image_adjuster_upload(&adjuster);
+            image_adjuster_upload(&compare_adjuster);
+            base_texture = adjuster.texture;
+            if (has_comparison) second_texture = compare_adjuster.texture;
+            gain = 1;
+        }
+        for (int v = 0; v < view_count; ++v) {
+            const Viewport* view = &views[v];
+            SDL_RenderSetViewport(renderer, &view->pane); // Clips to the pane; drawing below is pane-local
+            SDL_Rect image_rect = viewport_image_rect(view, SCREEN_WIDTH, SCREEN_HEIGHT);
+            comparison_draw(renderer, &comparison, base_texture, second_texture, view, SCREEN_WIDTH, SCREEN_HEIGHT, gain);
+
+            if (heatmap_enabled) { // Density replaces the individual markers
+                if (heatmap.texture) SDL_RenderCopy(renderer, heatmap.texture, NULL, &image_rect);
+            } else {
+                if (line_density_enabled) { // Hit counts per pixel instead of overdrawn lines
+                    if (line_density.texture) SDL_RenderCopy(renderer, line_density.texture, NULL, &image_rect);
+                } else {
+                    for (int i = 0; i < drawing.line_count; ++i) {
+                        if ((scrubber.enabled || filter_enabled) && !line_is_visible(&drawing, drawing.lines[i])) continue;
+                        draw_thick_line(renderer, drawing.lines[i], DRAW_LINE_THICKNESS, COLOR_RED, drawing.point_table, view);
+                        // Print debug info only once or when 'd' is pressed
+                        if (!debug_printed) {
+                            Point* p1 = hash_table_get(drawing.point_table, drawing.lines[i].label1);
+                            Point* p2 = hash_table_get(drawing.point_table, drawing.lines[i].label2);
+                            if (p1 && p2) {
+                                printf("Drawing line from %s (%d,%d) to %s (%d,%d)\n",
+                                       drawing.lines[i].label1, p1->x, p1->y,
+                                       drawing.lines[i].label2, p2->x, p2->y);
+                            }
+                        }
+                    }
+                    debug_printed = true; // Prevent repeated printing
+                }
+
+                if (cloud_enabled) { // One or four pixels per point, no labels
+                    if (cloud.texture) SDL_RenderCopy(renderer, cloud.texture, NULL, &image_rect);
+                } else {
+                    for (int i = 0; i < drawing.point_count; ++i) {
+                        if (drawing.point_flags[i]) continue;
+                        Point point = drawing.points[i];
+                        viewport_to_screen(view, point.x, point.y, &point.x, &point.y);
+                        if (point.x < -DRAW_POINT_RADIUS || point.y < -FONT_SIZE || point.x > view->pane.w + DRAW_POINT_RADIUS || point.y > view->pane.h + DRAW_POINT_RADIUS) {
+                            continue; // Culled; labels extend right of and above the marker
+                        }
+                        draw_point_with_label(renderer, point, DRAW_POINT_RADIUS, COLOR_BLACK, gFont);
+                    }
                 }
             }
+            if (minimap_enabled && viewport_is_partial(view, SCREEN_WIDTH, SCREEN_HEIGHT)) {
+                minimap_update(renderer, &minimap, image_texture, &drawing);
+                SDL_RenderSetViewport(renderer, &view->pane); // Rebuilding the minimap retargets the renderer
+                minimap_draw(renderer, &minimap, view);
+            }
         }
-        debug_printed = true; // Prevent repeated printing
-
-        for (int i = 0; i < loaded_point_count; ++i) {
-            draw_point_with_label(renderer, loaded_points[i], DRAW_POINT_RADIUS, COLOR_BLACK, gFont);
+        SDL_RenderSetViewport(renderer, NULL);
+        if (view_count > 1) { // Divider between the panes
+            set_draw_color(renderer, COLOR_BLACK);
+            for (int v = 1; v < view_count; ++v) {
+                SDL_RenderDrawLine(renderer, views[v].pane.x, 0, views[v].pane.x, SCREEN_HEIGHT);
+            }
         }
+        draw_time_scrubber(renderer, gFont, &drawing, &scrubber, SCREEN_WIDTH, SCREEN_HEIGHT);
+        draw_hud(renderer, gFont, &hud, image_surface, &histogram);
 
         SDL_RenderPresent(renderer);
+        histogram_start(&histogram); // No-op after the first frame
     }
 
-    free_loaded_drawing_data(loaded_points, loaded_point_count, loaded_lines, loaded_line_count, point_table);
+    heatmap_free(&heatmap);
+    point_cloud_free(&cloud);
+    line_density_free(&line_density);
+    minimap_free(&minimap);
+    image_adjuster_free(&compare_adjuster); // Before the surface it reads
+    comparison_free(&comparison);
+    image_adjuster_free(&adjuster);
+    histogram_free(&histogram);
+    edge_map_free(&edge_map);
+    if (image_surface) SDL_FreeSurface(image_surface);
+    free_filter(filter);
+    free_drawing(&drawing);
     if (gFont) TTF_CloseFont(gFont);
     SDL_DestroyTexture(image_texture);
     SDL_DestroyRenderer(renderer);